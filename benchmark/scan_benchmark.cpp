@@ -0,0 +1,112 @@
+// throughput of the text run scanners, and of the tokenizer using them.
+// usage: scan_benchmark [megabytes]
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "tokenizer/TextScanner.hpp"
+#include "tokenizer/Tokenizer.hpp"
+
+const int RUNS = 5;
+
+// the loop tokenizeText used before the scanners, for comparison. like
+// that loop it relies on the line break ending the text, not on last.
+const char* scanTextLoop(const char* p, const char*) {
+  while (!m2h::oneof(*p, "!*`[]()_") && !m2h::isCrlf(*p)) ++p;
+  return p;
+}
+
+// lines of words, with the markup of prose sprinkled in every so often
+std::string prose(size_t size, int markupPerLine) {
+  static const char* words[] = {"the",    "editor", "renders", "a",
+                                "preview", "of",    "markdown", "while",
+                                "you",    "type",   "into",    "it"};
+  static const char* markup[] = {"*", "_", "`", "[", "]", "(", ")", "!"};
+  std::mt19937 random(42);
+  auto text = std::string{};
+  text.reserve(size + 256);
+  while (text.size() < size) {
+    for (int i = 0; i < 14; ++i) {
+      text += words[random() % 12];
+      text += ' ';
+    }
+    for (int i = 0; i < markupPerLine; ++i) {
+      text.insert(text.size() - random() % 60, markup[random() % 8]);
+    }
+    text += '\n';
+  }
+  return text;
+}
+
+// stops at every special character, like tokenizeText does
+size_t scanAll(m2h::TextScanner scan, const std::string& text) {
+  size_t stops = 0;
+  const char* p = text.data();
+  const char* last = p + text.size();
+  while (p < last) {
+    p = scan(p, last);
+    if (p < last) ++p, ++stops;
+  }
+  return stops;
+}
+
+template <class Run>
+double gigabytesPerSecond(size_t bytes, Run&& run) {
+  double best = 0;
+  for (int i = 0; i < RUNS; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    const double rate = bytes / elapsed.count() / 1e9;
+    if (rate > best) best = rate;
+  }
+  return best;
+}
+
+int main(int argc, char const* argv[]) {
+  const size_t size = (argc > 1 ? std::atoi(argv[1]) : 64) << 20;
+  const struct {
+    const char* name;
+    m2h::TextScanner scan;
+  } scanners[] = {
+      {"byte loop", scanTextLoop},
+      {"scalar", m2h::scanTextScalar},
+#ifdef M2H_SCAN_X86
+      {"sse2", m2h::scanTextSse2},
+      {"avx2", m2h::scanTextAvx2},
+#endif
+  };
+
+  std::cout << std::fixed << std::setprecision(2);
+  for (int markup : {0, 2, 8}) {
+    const auto text = prose(size, markup);
+    std::cout << "prose, " << markup << " markup characters a line\n";
+    const size_t expected = scanAll(scanTextLoop, text);
+    for (auto&& scanner : scanners) {
+#ifdef M2H_SCAN_X86
+      if (scanner.scan == m2h::scanTextAvx2 &&
+          !__builtin_cpu_supports("avx2")) {
+        continue;
+      }
+#endif
+      if (scanAll(scanner.scan, text) != expected) {
+        std::cerr << scanner.name << " disagrees with the byte loop\n";
+        return 1;
+      }
+      volatile size_t sink = 0;
+      const double rate = gigabytesPerSecond(
+          text.size(), [&] { sink = scanAll(scanner.scan, text); });
+      std::cout << "  " << std::setw(10) << scanner.name << "  " << rate
+                << " GB/s\n";
+    }
+    m2h::Tokenizer tokenizer;
+    const double rate = gigabytesPerSecond(
+        text.size(), [&] { tokenizer.tokenize(text); });
+    std::cout << "  " << std::setw(10) << "tokenize" << "  " << rate
+              << " GB/s\n";
+  }
+}
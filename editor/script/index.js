@@ -5,18 +5,87 @@ window.onload = (ev) => {
   let editor = document.querySelector(".lpanel");
   let result = document.querySelector(".target");
 
-  editor.addEventListener("input", (ev) => {
+  // every edit gets a revision; only the newest rendering is shown
+  let revision = 0;
+  let shown = 0;
+  let live = null;
+  let sent = "";  // the document as the server has it
+  let request = null;  // the /update still in flight
+  const encoder = new TextEncoder();
+  const bytes = (text) => encoder.encode(text).length;
+
+  const connect = () => {
+    // a page served over https may only open a secure socket
+    const scheme = location.protocol === "https:" ? "wss://" : "ws://";
+    live = new WebSocket(scheme + location.host + "/live");
+    live.onopen = (ev) => {
+      sent = editor.value;
+      live.send(++revision + "\n" + sent);
+    }
+    live.onmessage = (ev) => {
+      const eol = ev.data.indexOf("\n");
+      const rev = parseInt(ev.data.substring(0, eol));
+      if (rev < shown) return;
+      shown = rev;
+      result.innerHTML = ev.data.substring(eol + 1);
+    }
+    live.onclose = (ev) => {
+      live = null;
+      setTimeout(connect, 1000);
+    }
+  }
+  connect();
+
+  // sends only the changed range: the text between the common prefix and
+  // suffix of what the server has and what the editor shows
+  const sendDelta = (text) => {
+    let start = 0;
+    const end = Math.min(sent.length, text.length);
+    while (start < end && sent[start] == text[start]) start++;
+    let tail = 0;
+    while (tail < end - start &&
+           sent[sent.length - 1 - tail] == text[text.length - 1 - tail]) {
+      tail++;
+    }
+    // don't split a surrogate pair
+    if (start > 0 && /[\ud800-\udbff]/.test(text[start - 1])) start--;
+    if (tail > 0 && /[\udc00-\udfff]/.test(text[text.length - tail])) tail--;
+
+    const offset = bytes(sent.substring(0, start));
+    const erase = bytes(sent.substring(start, sent.length - tail));
+    const insert = text.substring(start, text.length - tail);
+    live.send(++revision + " " + offset + " " + erase + "\n" + insert);
+    sent = text;
+  }
+
+  const update = (text) => {
+    if (live && live.readyState == WebSocket.OPEN) {
+      sendDelta(text);
+      return;
+    }
+    const rev = ++revision;
+    // its response would be replaced right away, so don't wait for it
+    if (request) request.abort();
     const xhr = new XMLHttpRequest();
+    request = xhr;
     xhr.open("POST", "/update", true);
+    xhr.onloadend = (ev) => {
+      if (request == xhr) request = null;
+    }
     xhr.onload = (ev) => {
-      if (xhr.readyState == 4 && xhr.status == 200) {
+      if (xhr.readyState == 4 && xhr.status == 200 && rev >= shown) {
+        shown = rev;
         result.innerHTML = xhr.responseText;
       }
     }
     xhr.onerror = (ev) => {
       console.error(xhr.statusText);
     }
-    xhr.send(ev.target.value);
+    xhr.send(text);
+  }
+
+  editor.addEventListener("input", (ev) => {
+    update(ev.target.value);
   });
 
   fileSelector.addEventListener("change", (ev) => {
@@ -40,4 +109,3 @@ window.onload = (ev) => {
   });
 
 }
-
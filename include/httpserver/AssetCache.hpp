@@ -0,0 +1,215 @@
+#pragma once
+
+#include <Compression.hpp>
+#include <HttpRequest.hpp>
+#include <HttpResponse.hpp>
+#include <common/StringUtils.hpp>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
+// files up to this size are kept in memory, larger ones are sent from disk
+const size_t MAX_CACHED_ASSET_SIZE = 64 * 1024;
+// assets are compressed once when loaded, so spend CPU for the fewest bytes
+const int ASSET_COMPRESSION_LEVEL = 9;
+
+// the Content-Type of a file, by its extension
+std::string mimetype(const std::string &target) {
+  auto mimetype = std::string{"text/html"};
+  if (endsWith(target, ".ico")) {
+    mimetype = "image/x-icon";
+  } else if (endsWith(target, ".js")) {
+    mimetype = "application/javascript";
+  } else if (endsWith(target, ".css")) {
+    mimetype = "text/css";
+  } else if (endsWith(target, ".png")) {
+    mimetype = "image/png";
+  }
+  return mimetype;
+}
+
+struct Asset {
+  std::string path;
+  std::string data;  // contents, empty unless cached
+  // compressed copies of data, empty unless smaller than it
+  std::string gzip;
+  std::string deflate;
+  bool cached;
+  size_t size;
+  long long mtime;  // nanoseconds since epoch
+  std::string etag;
+  std::string lastModified;
+};
+
+// in-memory cache of static files with validators for conditional GETs.
+// entries are revalidated against the file's size and mtime at most once
+// a second, so edits on disk show up without re-reading unchanged files.
+class AssetCache {
+ public:
+  explicit AssetCache(size_t maxCachedSize = MAX_CACHED_ASSET_SIZE)
+      : m_maxCachedSize{maxCachedSize} {}
+
+  // returns nullptr if path does not name a readable regular file
+  std::shared_ptr<const Asset> find(const std::string &path) {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(path);
+    if (it != m_entries.end() &&
+        now - it->second.checkedAt < std::chrono::seconds(1)) {
+      return it->second.asset;
+    }
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+      if (it != m_entries.end()) m_entries.erase(it);
+      return nullptr;
+    }
+    const long long mtime = modificationTime(st);
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (it != m_entries.end() && it->second.asset->mtime == mtime &&
+        it->second.asset->size == size) {
+      it->second.checkedAt = now;
+      return it->second.asset;
+    }
+
+    auto asset = load(path, size, mtime, st.st_mtime);
+    if (!asset) return nullptr;
+    m_entries[path] = Entry{asset, now};
+    return asset;
+  }
+
+  // loads every file under directory ahead of the first request for it
+  void preload(const std::string &directory) {
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(directory, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+      if (it->is_regular_file(ec)) find(it->path().string());
+    }
+  }
+
+ private:
+  struct Entry {
+    std::shared_ptr<const Asset> asset;
+    std::chrono::steady_clock::time_point checkedAt;
+  };
+
+  static long long modificationTime(const struct stat &st) {
+#ifdef __linux__
+    return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+    return st.st_mtime * 1000000000LL;
+#endif
+  }
+
+  static std::string httpDate(time_t t) {
+    std::tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &t);
+#else
+    gmtime_r(&t, &tm);
+#endif
+    char buffer[64];
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buffer;
+  }
+
+  std::shared_ptr<const Asset> load(const std::string &path, size_t size,
+                                    long long mtime, time_t seconds) {
+    auto asset = std::make_shared<Asset>();
+    asset->path = path;
+    asset->size = size;
+    asset->mtime = mtime;
+    std::stringstream etag;
+    etag << '"' << std::hex << size << '-' << mtime << '"';
+    asset->etag = etag.str();
+    asset->lastModified = httpDate(seconds);
+    asset->cached = false;
+#ifdef __linux__
+    if (size > m_maxCachedSize) return asset;
+#endif
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.is_open()) return nullptr;
+    asset->data.resize(size);
+    ifs.read(&asset->data[0], size);
+    asset->data.resize(ifs.gcount());
+    asset->cached = true;
+    asset->gzip = compressed(asset->data, ContentCoding::Gzip);
+    asset->deflate = compressed(asset->data, ContentCoding::Deflate);
+    return asset;
+  }
+
+  // without zlib compress() returns data as it is, which is dropped here
+  static std::string compressed(const std::string &data, ContentCoding coding) {
+    auto ret = compress(data, coding, ASSET_COMPRESSION_LEVEL);
+    return ret.size() < data.size() ? ret : std::string{};
+  }
+
+  size_t m_maxCachedSize;
+  std::mutex m_mutex;
+  std::unordered_map<std::string, Entry> m_entries;
+};
+
+// true if the client's cached copy, named by If-None-Match or
+// If-Modified-Since, is still current
+bool isNotModified(const HttpRequestHeader &header, std::string_view etag,
+                   std::string_view lastModified) {
+  const auto match = valueOf(header, "If-None-Match");
+  if (!match.empty()) return match == etag || match == "*";
+  const auto since = valueOf(header, "If-Modified-Since");
+  return !since.empty() && since == lastModified;
+}
+
+// builds a 200 response carrying the asset, or a 304 if the client's copy
+// is current. a compressed copy is sent if the client accepts one, under
+// an ETag of its own. uncached assets are attached as a FileBody for
+// sendfile.
+HttpResponse assetResponse(const HttpRequestHeader &header, const Asset &asset,
+                           const std::string &mimetype) {
+  const auto coding =
+      negotiateEncoding(header, !asset.gzip.empty(), !asset.deflate.empty());
+  const auto &data = coding == ContentCoding::Gzip      ? asset.gzip
+                     : coding == ContentCoding::Deflate ? asset.deflate
+                                                        : asset.data;
+  const auto etag = codedEtag(asset.etag, coding);
+
+  auto resp = HttpResponse{"HTTP/1.1 200 OK", mimetype, ""};
+  resp.headers.emplace_back("ETag", etag);
+  resp.headers.emplace_back("Last-Modified", asset.lastModified);
+  resp.headers.emplace_back("Cache-Control", "no-cache");
+  if (!asset.gzip.empty() || !asset.deflate.empty()) {
+    resp.headers.emplace_back("Vary", "Accept-Encoding");
+  }
+  if (isNotModified(header, etag, asset.lastModified)) {
+    resp.message = "HTTP/1.1 304 Not Modified";
+    return resp;
+  }
+  if (coding != ContentCoding::Identity) {
+    resp.headers.emplace_back("Content-Encoding", codingName(coding));
+  }
+  if (asset.cached) {
+    resp.body = data;
+    return resp;
+  }
+#ifdef __linux__
+  const int fd = open(asset.path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return HttpResponse{"HTTP/1.1 404 Not Found", "text/html", "404 Not Found"};
+  }
+  resp.file = std::make_shared<FileBody>(fd, asset.size);
+#endif
+  return resp;
+}
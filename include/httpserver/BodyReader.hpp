@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+// consumes a request body piece by piece while it is still being received.
+// read() is called on the event loop thread in arrival order; the reader is
+// then handed to the request handler through HttpRequest::reader.
+struct BodyReader {
+  virtual ~BodyReader() = default;
+  virtual void read(std::string_view data) = 0;
+};
+
+// creates a reader for a body of the given Content-Length
+using BodyReaderFactory =
+    std::function<std::shared_ptr<BodyReader>(size_t contentLength)>;
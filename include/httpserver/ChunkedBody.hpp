@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+const size_t CHUNK_SIZE = 16 * 1024;
+
+// body of a response sent with chunked transfer encoding.
+// a worker pushes chunks while it renders, the event loop pops and sends
+// them as the socket allows.
+class ChunkedBody {
+ public:
+  ChunkedBody() : m_chunks{}, m_closed{false}, m_cancelled{false} {}
+
+  void push(std::string &&chunk) {
+    if (chunk.empty()) return;  // an empty chunk would end the body
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_cancelled) return;
+    m_chunks.push_back(std::move(chunk));
+  }
+
+  // marks the end of the body
+  void close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closed = true;
+  }
+
+  // drops the remaining output once nobody is left to receive it
+  void cancel() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cancelled = true;
+    m_chunks.clear();
+  }
+
+  bool cancelled() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cancelled;
+  }
+
+  // returns false if no chunk is ready yet
+  bool pop(std::string &chunk) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_chunks.empty()) return false;
+    chunk = std::move(m_chunks.front());
+    m_chunks.pop_front();
+    return true;
+  }
+
+  // true once close() was called and every chunk has been popped
+  bool drained() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_closed && m_chunks.empty();
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::deque<std::string> m_chunks;
+  bool m_closed;
+  bool m_cancelled;
+};
+
+// ostream buffer that cuts what is written to it into CHUNK_SIZE pieces
+// and pushes them to a ChunkedBody, calling notify after each one.
+// flushes (std::endl) are ignored so lines don't become tiny chunks.
+class ChunkedStreamBuf : public std::streambuf {
+ public:
+  // turns a piece of the body into what is sent; last ends the body
+  using Encoder = std::function<std::string(std::string_view, bool last)>;
+  // told the whole body if it ended within the held bytes, else nullptr
+  using Start = std::function<void(std::string *whole)>;
+
+  ChunkedStreamBuf(std::shared_ptr<ChunkedBody> body,
+                   std::function<void()> notify)
+      : m_body{std::move(body)},
+        m_notify{std::move(notify)},
+        m_buffer{},
+        m_failed{false},
+        m_hold{0},
+        m_start{},
+        m_encoder{} {
+    m_buffer.reserve(CHUNK_SIZE);
+  }
+
+  // keeps the first bytes of the body back until there are more than
+  // bytes of them or the body ends, then calls start. if the whole body
+  // fit, nothing is pushed and it is up to start to send it.
+  void hold(size_t bytes, Start start) {
+    m_hold = bytes;
+    m_start = std::move(start);
+  }
+
+  // passes every chunk through encoder before it is pushed
+  void encode(Encoder encoder) { m_encoder = std::move(encoder); }
+
+  // pushes what is left and ends the body
+  void close() {
+    if (m_start) {
+      auto start = std::move(m_start);
+      m_start = nullptr;
+      start(&m_buffer);
+      return;
+    }
+    flush();
+    if (m_encoder && !m_failed) m_body->push(m_encoder("", true));
+    m_body->close();
+    m_notify();
+  }
+
+ protected:
+  // writes fail once the body was cancelled, which stops the ostream
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof())) return 0;
+    if (m_failed) return traits_type::eof();
+    m_buffer += traits_type::to_char_type(c);
+    if (m_buffer.size() >= threshold()) flush();
+    return c;
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    if (m_failed) return 0;
+    m_buffer.append(s, n);
+    if (m_buffer.size() >= threshold()) flush();
+    return n;
+  }
+
+  int sync() override { return 0; }
+
+ private:
+  size_t threshold() const {
+    return m_start && m_hold > CHUNK_SIZE ? m_hold : CHUNK_SIZE;
+  }
+
+  void flush() {
+    if (m_start) {
+      if (m_buffer.size() <= m_hold) return;
+      auto start = std::move(m_start);
+      m_start = nullptr;
+      start(nullptr);
+    }
+    if (m_buffer.empty()) return;
+    m_body->push(m_encoder ? m_encoder(m_buffer, false) : std::move(m_buffer));
+    m_buffer = std::string{};
+    m_buffer.reserve(CHUNK_SIZE);
+    m_failed = m_body->cancelled();
+    m_notify();
+  }
+
+  std::shared_ptr<ChunkedBody> m_body;
+  std::function<void()> m_notify;
+  std::string m_buffer;
+  bool m_failed;
+  size_t m_hold;
+  Start m_start;  // set until the held bytes are passed on
+  Encoder m_encoder;
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <HttpRequest.hpp>
+#include <common/StringUtils.hpp>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+const int COMPRESSION_LEVEL = 6;   // zlib's default trade of CPU for bytes
+const size_t COMPRESS_MIN_SIZE = 1024;  // smaller bodies aren't worth it
+
+enum class ContentCoding { Identity, Gzip, Deflate };
+
+const char *codingName(ContentCoding coding) {
+  switch (coding) {
+    case ContentCoding::Gzip:
+      return "gzip";
+    case ContentCoding::Deflate:
+      return "deflate";
+    default:
+      return "identity";
+  }
+}
+
+bool isCompressible(const std::string &mimetype) {
+  return beginsWith(mimetype, "text/") || contains(mimetype, "javascript") ||
+         contains(mimetype, "json") || contains(mimetype, "xml") ||
+         mimetype == "image/x-icon";
+}
+
+// picks the coding for a response from the request's Accept-Encoding,
+// preferring gzip. codings with q=0 are refused. without zlib, always
+// Identity.
+ContentCoding negotiateEncoding(const HttpRequestHeader &header) {
+#ifdef HAVE_ZLIB
+  const auto accept = valueOf(header, "Accept-Encoding");
+  double gzip = 0, deflate = 0;
+  size_t pos = 0;
+  while (pos < accept.size()) {
+    auto end = accept.find(',', pos);
+    if (end == std::string_view::npos) end = accept.size();
+    auto item = accept.substr(pos, end - pos);
+    pos = end + 1;
+
+    double q = 1;
+    const auto semicolon = item.find(';');
+    if (semicolon != std::string_view::npos) {
+      const auto param = item.find("q=", semicolon);
+      if (param != std::string_view::npos) {
+        q = std::atof(std::string{item.substr(param + 2)}.c_str());
+      }
+      item = item.substr(0, semicolon);
+    }
+    while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+    while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+    if (equalsIgnoreCase(item, "gzip") || equalsIgnoreCase(item, "x-gzip")) {
+      gzip = q;
+    } else if (equalsIgnoreCase(item, "deflate")) {
+      deflate = q;
+    } else if (item == "*") {
+      if (gzip == 0) gzip = q;
+    }
+  }
+  if (gzip > 0 && gzip >= deflate) return ContentCoding::Gzip;
+  if (deflate > 0) return ContentCoding::Deflate;
+#endif
+  return ContentCoding::Identity;
+}
+
+// picks among the precompressed copies of a body the client accepts,
+// Identity if it takes neither
+ContentCoding negotiateEncoding(const HttpRequestHeader &header,
+                                bool haveGzip, bool haveDeflate) {
+  const auto coding = negotiateEncoding(header);
+  if (coding == ContentCoding::Gzip && haveGzip) return coding;
+  if (coding == ContentCoding::Deflate && haveDeflate) return coding;
+  return ContentCoding::Identity;
+}
+
+// a compressed copy is a representation of its own and needs its own tag
+std::string codedEtag(std::string_view etag, ContentCoding coding) {
+  auto ret = std::string{etag};
+  if (coding != ContentCoding::Identity && ret.size() >= 2) {
+    ret.insert(ret.size() - 1, std::string{"-"} + codingName(coding));
+  }
+  return ret;
+}
+
+// incremental compressor for a body written in pieces. every piece is
+// flushed so the client can decode what it has received so far.
+class Deflater {
+ public:
+  Deflater(ContentCoding coding, int level) {
+#ifdef HAVE_ZLIB
+    // deflate in HTTP means the zlib format, gzip adds its own wrapper
+    const int windowBits = coding == ContentCoding::Gzip ? 15 + 16 : 15;
+    m_stream = z_stream{};
+    deflateInit2(&m_stream, level, Z_DEFLATED, windowBits, 8,
+                 Z_DEFAULT_STRATEGY);
+#endif
+  }
+
+#ifdef HAVE_ZLIB
+  ~Deflater() { deflateEnd(&m_stream); }
+#endif
+
+  Deflater(const Deflater &) = delete;
+  Deflater &operator=(const Deflater &) = delete;
+
+  // compresses data; with last set, also ends the compressed stream
+  std::string operator()(std::string_view data, bool last) {
+#ifdef HAVE_ZLIB
+    auto out = std::string{};
+    m_stream.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    m_stream.avail_in = static_cast<uInt>(data.size());
+    const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+    size_t produced = 0;
+    do {
+      out.resize(produced + deflateBound(&m_stream, m_stream.avail_in) + 16);
+      m_stream.next_out = reinterpret_cast<Bytef *>(&out[produced]);
+      m_stream.avail_out = static_cast<uInt>(out.size() - produced);
+      deflate(&m_stream, flush);
+      produced = out.size() - m_stream.avail_out;
+    } while (m_stream.avail_out == 0);
+    out.resize(produced);
+    return out;
+#else
+    return std::string{data};
+#endif
+  }
+
+ private:
+#ifdef HAVE_ZLIB
+  z_stream m_stream;
+#endif
+};
+
+// compresses a whole body in one go
+std::string compress(std::string_view data, ContentCoding coding, int level) {
+  Deflater deflater(coding, level);
+  return deflater(data, true);
+}
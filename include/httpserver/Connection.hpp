@@ -0,0 +1,87 @@
+#pragma once
+
+#include <RequestParser.hpp>
+#include <ResponseWriter.hpp>
+#include <TimerWheel.hpp>
+#include <WebSocket.hpp>
+#include <cstddef>
+
+const size_t BUFFER_SIZE = 8192;
+
+#ifdef __linux__
+
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// per-connection read/write state of a non-blocking client socket
+struct Connection {
+  enum class State { Reading, Processing, Writing, WebSocket, Closed };
+
+  explicit Connection(int fd, uint64_t id, size_t maxBodySize)
+      : fd{fd},
+        id{id},
+        state{State::Reading},
+        inbuf{},
+        parser{maxBodySize},
+        reader{},
+        writer{},
+        body{},
+        requests{0},
+        keepAlive{false},
+        peerClosed{false},
+        timer{static_cast<uint64_t>(fd)},
+        requestStart{},
+        socket{},
+        session{},
+        message{},
+        frame{},
+        frameSent{0} {}
+
+  // reads until the socket would block or inbuf holds limit bytes.
+  // returns false once the peer has closed or the socket failed.
+  bool receive(size_t limit) {
+    char buffer[BUFFER_SIZE];
+    while (inbuf.size() < limit) {
+      ssize_t n = recv(fd, buffer, BUFFER_SIZE, 0);
+      if (n > 0) {
+        inbuf.append(buffer, n);
+        continue;
+      }
+      if (n == 0) return false;
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    return true;
+  }
+
+  int fd;
+  uint64_t id;  // tells a reused fd apart from the connection it replaced
+  State state;
+  std::string inbuf;
+  RequestParser parser;  // parses inbuf as it fills up
+  std::shared_ptr<BodyReader> reader;  // set while a body is streamed
+  ResponseWriter writer;
+  // the body a worker may stream the current response into, cancelled if
+  // the connection is dropped before the response reaches the writer
+  std::shared_ptr<ChunkedBody> body;
+  size_t requests;  // requests received on this connection
+  bool keepAlive;   // whether to keep reading after the current response
+  bool peerClosed;
+  TimerWheel::Timer timer;  // the header, body, idle or send timeout
+  // when the first bytes of the request being read arrived, if any did
+  std::chrono::steady_clock::time_point requestStart;
+
+  // set once the connection has been upgraded to a WebSocket
+  std::shared_ptr<WebSocket> socket;
+  std::shared_ptr<WebSocketSession> session;
+  std::string message;  // payload of a fragmented message so far
+  std::string frame;    // outgoing frame being written
+  size_t frameSent;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <AssetCache.hpp>
+#include <Compression.hpp>
+#include <HttpRequest.hpp>
+#include <HttpResponse.hpp>
+#include <string>
+#include <string_view>
+
+// a static file compiled into the binary by the embed_assets tool, with
+// everything a response needs worked out at build time
+struct EmbeddedAsset {
+  std::string_view path;  // as requested, e.g. "/css/index.css"
+  std::string_view mimetype;
+  std::string_view etag;  // of the contents, quoted
+  std::string_view data;
+  std::string_view gzip;  // compressed copies, empty unless smaller
+  std::string_view deflate;
+};
+
+// builds a 200 response carrying the asset, or a 304 if the client's copy
+// is current. nothing is read from disk.
+HttpResponse embeddedResponse(const HttpRequestHeader &header,
+                              const EmbeddedAsset &asset) {
+  const auto coding =
+      negotiateEncoding(header, !asset.gzip.empty(), !asset.deflate.empty());
+  const auto data = coding == ContentCoding::Gzip      ? asset.gzip
+                    : coding == ContentCoding::Deflate ? asset.deflate
+                                                       : asset.data;
+  const auto etag = codedEtag(asset.etag, coding);
+
+  auto resp = HttpResponse{"HTTP/1.1 200 OK", std::string{asset.mimetype}, ""};
+  resp.headers.emplace_back("ETag", etag);
+  resp.headers.emplace_back("Cache-Control", "no-cache");
+  if (!asset.gzip.empty() || !asset.deflate.empty()) {
+    resp.headers.emplace_back("Vary", "Accept-Encoding");
+  }
+  if (isNotModified(header, etag, "")) {
+    resp.message = "HTTP/1.1 304 Not Modified";
+    return resp;
+  }
+  if (coding != ContentCoding::Identity) {
+    resp.headers.emplace_back("Content-Encoding", codingName(coding));
+  }
+  resp.body = std::string{data};
+  return resp;
+}
+
+// the asset served for path, nullptr if there is none
+template <size_t N>
+const EmbeddedAsset *findEmbedded(const EmbeddedAsset (&assets)[N],
+                                  std::string_view path) {
+  for (auto &&asset : assets) {
+    if (asset.path == path) return &asset;
+  }
+  return nullptr;
+}
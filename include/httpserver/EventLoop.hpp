@@ -0,0 +1,209 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <IoUring.hpp>
+#include <sys/epoll.h>
+#include <unistd.h>  // for close
+
+#include <cerrno>
+#include <cstdint>
+#include <vector>
+
+const size_t MAX_EVENTS = 256;
+
+// readiness notifications for a set of fds, from an epoll instance or,
+// if asked for and the kernel supports it, from multishot polls on an
+// io_uring. registrations then cost no system call of their own: they
+// are submitted along with the next wait.
+struct EventLoop {
+  explicit EventLoop(bool useIoUring = false)
+      : m_epoll{-1}, m_events(MAX_EVENTS) {
+#ifdef HAVE_IO_URING
+    // multishot polls came in 5.13, along with resource tags
+    m_uring = useIoUring && m_ring.init() &&
+              (m_ring.features() & IORING_FEAT_RSRC_TAGS) &&
+              m_ring.supports(IORING_OP_POLL_ADD) &&
+              m_ring.supports(IORING_OP_POLL_REMOVE);
+    // multishot accept came along with IORING_OP_SOCKET, in 5.19
+    m_multishotAccept = m_uring && m_ring.supports(IORING_OP_SOCKET);
+    if (m_uring) return;
+#endif
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  }
+
+  ~EventLoop() {
+    if (m_epoll >= 0) close(m_epoll);
+  }
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  bool ioUring() const {
+#ifdef HAVE_IO_URING
+    return m_uring;
+#else
+    return false;
+#endif
+  }
+
+  bool add(int fd, uint32_t events) {
+#ifdef HAVE_IO_URING
+    if (m_uring) {
+      watch(fd, events);
+      return true;
+    }
+#endif
+    return control(EPOLL_CTL_ADD, fd, events);
+  }
+
+  bool modify(int fd, uint32_t events) {
+#ifdef HAVE_IO_URING
+    if (m_uring) {
+      remove(fd);
+      watch(fd, events);
+      return true;
+    }
+#endif
+    return control(EPOLL_CTL_MOD, fd, events);
+  }
+
+  void remove(int fd) {
+#ifdef HAVE_IO_URING
+    if (m_uring) {
+      if (size_t(fd) >= m_watches.size() || !m_watches[fd].events) return;
+      auto &sqe = m_ring.next();
+      sqe.opcode = IORING_OP_POLL_REMOVE;
+      sqe.fd = -1;
+      sqe.addr = m_watches[fd].tag;
+      sqe.user_data = CANCEL;
+      m_watches[fd].events = 0;
+      return;
+    }
+#endif
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+  }
+
+  // watches a non-blocking listening socket. with multishot accept the
+  // kernel accepts connections itself and poll hands them to onAccept,
+  // otherwise the socket is reported ready and the caller accepts.
+  void listen(int socket) {
+#ifdef HAVE_IO_URING
+    if (m_multishotAccept) {
+      acceptOn(socket);
+      return;
+    }
+#endif
+    add(socket, EPOLLIN | EPOLLET);
+  }
+
+  // waits for readiness and calls onReady(fd, events) for each ready fd,
+  // and onAccept(client) for each connection accepted by the kernel
+  template <class OnReady, class OnAccept>
+  void poll(int timeoutMs, OnReady &&onReady, OnAccept &&onAccept) {
+#ifdef HAVE_IO_URING
+    if (m_uring) {
+      m_ring.wait(timeoutMs, m_completions);
+      for (auto &&cqe : m_completions) {
+        dispatch(cqe, onReady, onAccept);
+      }
+      return;
+    }
+#endif
+    int n = epoll_wait(m_epoll, m_events.data(), m_events.size(), timeoutMs);
+    for (int i = 0; i < n; ++i) {
+      onReady(m_events[i].data.fd, m_events[i].events);
+    }
+  }
+
+ private:
+  bool control(int op, int fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(m_epoll, op, fd, &ev) == 0;
+  }
+
+  int m_epoll;
+  std::vector<epoll_event> m_events;
+
+#ifdef HAVE_IO_URING
+  // user_data of a completion: what it is for in the top bits, then a
+  // generation that tells a reused fd from the one it replaced, then the fd
+  static constexpr uint64_t POLL = uint64_t{0} << 62;
+  static constexpr uint64_t ACCEPT = uint64_t{1} << 62;
+  static constexpr uint64_t CANCEL = uint64_t{2} << 62;
+  static constexpr uint64_t KIND = uint64_t{3} << 62;
+
+  struct Watch {
+    uint32_t events;  // 0 unless watched
+    uint32_t generation;
+    uint64_t tag;  // user_data of the poll
+  };
+
+  // a multishot poll; it stays armed and completes every time fd becomes
+  // ready, which matches what edge-triggered epoll reports
+  void watch(int fd, uint32_t events) {
+    if (size_t(fd) >= m_watches.size()) m_watches.resize(fd + 1, Watch{});
+    auto &watch = m_watches[fd];
+    watch.events = events & ~uint32_t(EPOLLET);
+    ++watch.generation;
+    watch.tag = POLL | (uint64_t{watch.generation} << 32) | uint32_t(fd);
+    arm(fd);
+  }
+
+  void arm(int fd) {
+    auto &sqe = m_ring.next();
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = fd;
+    sqe.len = IORING_POLL_ADD_MULTI;
+    sqe.poll32_events = m_watches[fd].events;
+    sqe.user_data = m_watches[fd].tag;
+  }
+
+  void acceptOn(int socket) {
+    auto &sqe = m_ring.next();
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.fd = socket;
+    sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe.accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe.user_data = ACCEPT | uint32_t(socket);
+  }
+
+  template <class OnReady, class OnAccept>
+  void dispatch(const io_uring_cqe &cqe, OnReady &onReady,
+                OnAccept &onAccept) {
+    const int fd = static_cast<int>(uint32_t(cqe.user_data));
+    const bool more = cqe.flags & IORING_CQE_F_MORE;
+    switch (cqe.user_data & KIND) {
+      case ACCEPT:
+        if (cqe.res >= 0) onAccept(cqe.res);
+        if (more) return;
+        // it stopped on an error such as EMFILE. from here on the caller
+        // accepts on readiness and deals with errors as with epoll.
+        add(fd, EPOLLIN | EPOLLET);
+        onReady(fd, EPOLLIN);
+        return;
+      case POLL: {
+        if (size_t(fd) >= m_watches.size()) return;
+        const auto &watch = m_watches[fd];
+        if (!watch.events || watch.tag != cqe.user_data) return;  // stale
+        // the kernel may end a multishot poll, e.g. when completions overflow
+        if (!more && cqe.res >= 0) arm(fd);
+        if (cqe.res > 0) onReady(fd, uint32_t(cqe.res));
+        return;
+      }
+      default:
+        return;
+    }
+  }
+
+  IoUring m_ring;
+  bool m_uring;
+  bool m_multishotAccept;
+  std::vector<Watch> m_watches;  // by fd
+  std::vector<io_uring_cqe> m_completions;
+#endif
+};
+
+#endif
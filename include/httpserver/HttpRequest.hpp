@@ -1,18 +1,89 @@
 #pragma once
 
+#include <BodyReader.hpp>
 #include <common/StringUtils.hpp>
-#include <map>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+using HttpHeaderField = std::pair<std::string_view, std::string_view>;
+
 struct HttpRequestHeader {
-  std::string method;
-  std::string path;
-  std::string version;
-  std::map<std::string, std::string> headers;
+  std::string_view method;
+  std::string_view path;
+  std::string_view version;
+  std::vector<HttpHeaderField> headers;
 };
 
+// all fields are views into raw, the bytes the request was parsed from.
+// copies and moves re-point the views at their own raw buffer.
+// if the body was streamed into a BodyReader, body is empty and the
+// reader holds whatever it made of it.
 struct HttpRequest {
+  HttpRequest() = default;
+
+  HttpRequest(const HttpRequest &other)
+      : raw{other.raw}, reader{other.reader} {
+    rebase(other, other.raw.data());
+  }
+
+  HttpRequest(HttpRequest &&other) noexcept {
+    const char *base = other.raw.data();
+    raw = std::move(other.raw);
+    reader = std::move(other.reader);
+    rebase(other, base);
+  }
+
+  HttpRequest &operator=(const HttpRequest &other) {
+    if (this != &other) {
+      raw = other.raw;
+      reader = other.reader;
+      rebase(other, other.raw.data());
+    }
+    return *this;
+  }
+
+  HttpRequest &operator=(HttpRequest &&other) noexcept {
+    if (this != &other) {
+      const char *base = other.raw.data();
+      raw = std::move(other.raw);
+      reader = std::move(other.reader);
+      rebase(other, base);
+    }
+    return *this;
+  }
+
+  std::string raw;
   HttpRequestHeader header;
-  std::string body;
+  std::string_view body;
+  std::shared_ptr<BodyReader> reader;
+
+ private:
+  std::string_view translate(std::string_view v, const char *base) const {
+    if (v.data() == nullptr) return {};
+    return {raw.data() + (v.data() - base), v.size()};
+  }
+
+  void rebase(const HttpRequest &other, const char *base) {
+    header.method = translate(other.header.method, base);
+    header.path = translate(other.header.path, base);
+    header.version = translate(other.header.version, base);
+    header.headers.clear();
+    for (auto &&field : other.header.headers) {
+      header.headers.emplace_back(translate(field.first, base),
+                                  translate(field.second, base));
+    }
+    body = translate(other.body, base);
+  }
 };
+
+// case-insensitive header lookup; returns an empty view if key is absent
+std::string_view valueOf(const HttpRequestHeader &header,
+                         std::string_view key) {
+  for (auto &&field : header.headers) {
+    if (equalsIgnoreCase(field.first, key)) return field.second;
+  }
+  return {};
+}
@@ -1,9 +1,66 @@
 #pragma once
 
+#include <ChunkedBody.hpp>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>  // for close
+#elif _WIN32
+#include <io.h>  // for _close
+#endif
+
+// an open file sent after the header in place of body
+struct FileBody {
+  FileBody(int fd, size_t size) : fd{fd}, size{size} {}
+  ~FileBody() {
+#ifdef __linux__
+    close(fd);
+#elif _WIN32
+    _close(fd);
+#endif
+  }
+  FileBody(const FileBody &) = delete;
+  FileBody &operator=(const FileBody &) = delete;
+
+  int fd;
+  size_t size;
+};
 
 struct HttpResponse {
+  HttpResponse() = default;
+  HttpResponse(std::string message, std::string mimetype, std::string body)
+      : message{std::move(message)},
+        mimetype{std::move(mimetype)},
+        body{std::move(body)},
+        headers{},
+        file{},
+        stream{},
+        chunks{} {}
+
   std::string message;
   std::string mimetype;
   std::string body;
+  std::vector<std::pair<std::string, std::string>> headers;  // extra fields
+  std::shared_ptr<FileBody> file;
+  // if set, writes the body instead of body. the server calls it on the
+  // handler's worker right after the handler returns and sends what it
+  // writes with chunked transfer encoding while it is still running.
+  std::function<void(std::ostream &)> stream;
+  std::shared_ptr<ChunkedBody> chunks;  // set by the server for stream
 };
+
+// runs resp.stream into resp.body, for peers that can't take chunks
+void materialize(HttpResponse &resp) {
+  if (!resp.stream) return;
+  std::stringstream ss;
+  resp.stream(ss);
+  resp.body = ss.str();
+  resp.stream = nullptr;
+}
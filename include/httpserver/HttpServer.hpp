@@ -1,23 +1,41 @@
+#include <Compression.hpp>
+#include <Connection.hpp>
+#include <EventLoop.hpp>
 #include <HttpRequest.hpp>
 #include <HttpResponse.hpp>
+#include <RequestParser.hpp>
+#include <ResponseWriter.hpp>
+#include <ThreadPool.hpp>
+#include <TimerWheel.hpp>
+#include <WebSocket.hpp>
 #include <common/StringUtils.hpp>
+#include <chrono>
 #include <csignal>
 #include <cstdlib>
+#include <functional>
 #include <future>
+#include <map>
 #include <iostream>
-#include <sstream>
+#include <string>
 #include <thread>
 #include <vector>
 
 #ifdef __linux__
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <string.h>  // for memset
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <unistd.h>  // for close
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #elif _WIN32
 
 #include <winsock2.h>
@@ -25,71 +43,117 @@
 
 #endif
 
-const size_t BUFFER_SIZE = 8192;
-const size_t MAX_CONNECTIONS = 5;
+// seconds a client gets to send a whole request header, to send the next
+// piece of a body, and to take the next piece of a response
+const int HEADER_TIMEOUT = 10;
+const int BODY_TIMEOUT = 30;
+const int SEND_TIMEOUT = 30;
 
-std::string valueOf(const HttpRequestHeader &header, const std::string &key) {
-  auto headers = header.headers;
-  auto it = headers.find(key);
-  if (it == headers.end()) return "";
-  return it->second;
-}
+const size_t MAX_QUEUED_REQUESTS = 1024;
+const int LATENCY_BUDGET = 2000;  // milliseconds
+const int RETRY_AFTER = 1;        // seconds
 
-HttpRequest parseRequest(int client, const std::string &readData) {
-  if (readData.empty()) return HttpRequest{};
-  std::vector<std::string> headerbody = split(readData, "\r\n\r\n");
-  auto header = headerbody[0];
-  auto lines = split(header, "\r\n");
-  // parse header message
-  auto message = split(lines[0], " ");
-  auto requestHeader = HttpRequestHeader{};
-  requestHeader.method = message[0];
-  requestHeader.path = message[1];
-  requestHeader.version = message[2];
-  // parse header attrs
-  for (size_t i = 1; i < lines.size(); ++i) {
-    auto pair = split(lines[i], ": ");
-    requestHeader.headers[pair[0]] = pair[1];
-  }
-  // parse body
-  auto body = headerbody[1];
-  // parse remaining body
-  const auto contentLength = valueOf(requestHeader, "Content-Length");
-  if (contentLength != "") {
-    const auto len = std::stoi(contentLength);
-    char buffer[BUFFER_SIZE];
-    while (body.size() < len) {
-      int n = recv(client, buffer, BUFFER_SIZE, 0);
-      if (n > 0) body.append(buffer, n);
-    }
-  }
-  return HttpRequest{requestHeader, body};
+// where and how the server listens, and how much work it takes on
+struct HttpServerOptions {
+  std::string address = "0.0.0.0";  // a host name or numeric address
+  unsigned short port = 8000;
+  int backlog = SOMAXCONN;  // pending connections the kernel queues
+  // listening sockets, each with its own event loop thread. more than one
+  // shares the port through SO_REUSEPORT, so the kernel spreads incoming
+  // connections over them. linux only.
+  size_t acceptors = 1;
+  size_t workers = std::thread::hardware_concurrency();
+  // requests waiting for a worker; more are answered with 503 right away
+  size_t maxQueued = MAX_QUEUED_REQUESTS;
+  // longest a request may wait for a worker. requests that waited longer
+  // are answered with 503 instead of being handled, and new ones are
+  // turned away while recent requests have been waiting this long.
+  std::chrono::milliseconds latencyBudget{LATENCY_BUDGET};
+  // zlib level for response bodies the client accepts compressed, 1 for
+  // the least CPU to 9 for the fewest bytes. 0 turns compression off.
+  int compressionLevel = COMPRESSION_LEVEL;
+  // bodies smaller than this are sent as they are
+  size_t compressMinSize = COMPRESS_MIN_SIZE;
+  // wait for sockets through io_uring instead of epoll, where the build
+  // and the kernel allow it. linux only.
+  bool ioUring = false;
+};
+
+// HTTP/1.1 connections persist unless the client asks to close them,
+// HTTP/1.0 ones only when the client asks to keep them.
+bool wantsKeepAlive(const HttpRequest &request) {
+  const auto connection = valueOf(request.header, "Connection");
+  if (request.header.version == "HTTP/1.0") {
+    return equalsIgnoreCase(connection, "keep-alive");
+  }
+  return !equalsIgnoreCase(connection, "close");
 }
 
 struct HttpServer {
-  HttpServer(unsigned short port) : m_socket{} {
+  explicit HttpServer(const HttpServerOptions &options)
+      : m_sockets{},
+        m_workers{options.workers},
+        m_keepAliveTimeout{KEEP_ALIVE_TIMEOUT},
+        m_headerTimeout{HEADER_TIMEOUT},
+        m_bodyTimeout{BODY_TIMEOUT},
+        m_sendTimeout{SEND_TIMEOUT},
+        m_maxRequests{MAX_KEEP_ALIVE_REQUESTS},
+        m_maxBodySize{MAX_BODY_SIZE},
+        m_maxQueued{options.maxQueued},
+        m_latencyBudget{options.latencyBudget},
+        m_retryAfter{RETRY_AFTER},
+        m_compressionLevel{options.compressionLevel},
+        m_compressMinSize{options.compressMinSize},
+        m_ioUring{options.ioUring} {
 #ifdef _WIN32
     WSADATA data;
     WSAStartup(MAKEWORD(2, 0), &data);
 #endif
-    sockaddr_in serverAddr;
-    memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_port = htons(port);
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
-    m_socket = socket(AF_INET, SOCK_STREAM, 0);
-
-    if (bind(m_socket, (sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
-      std::cerr << "[error] failed to bind" << std::endl;
-      closeConnection(m_socket);
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *addr = nullptr;
+    const auto port = std::to_string(options.port);
+    if (getaddrinfo(options.address.c_str(), port.c_str(), &hints, &addr) !=
+            0 ||
+        addr == nullptr) {
+      std::cerr << "[error] failed to resolve " << options.address
+                << std::endl;
       exit(1);
     }
 
-    if (listen(m_socket, MAX_CONNECTIONS) < 0) {
-      std::cerr << "[error] failed to listen" << std::endl;
-      closeConnection(m_socket);
-      exit(1);
+#ifdef __linux__
+    const size_t acceptors = options.acceptors == 0 ? 1 : options.acceptors;
+#else
+    const size_t acceptors = 1;
+#endif
+    for (size_t i = 0; i < acceptors; ++i) {
+      int sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+      m_sockets.push_back(sock);
+#ifdef __linux__
+      // rebinding right after a restart must not wait for TIME_WAIT
+      const int on = 1;
+      setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      if (acceptors > 1) {
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+      }
+#endif
+
+      if (bind(sock, addr->ai_addr, addr->ai_addrlen) < 0) {
+        std::cerr << "[error] failed to bind" << std::endl;
+        shutdown();
+        exit(1);
+      }
+
+      if (listen(sock, options.backlog) < 0) {
+        std::cerr << "[error] failed to listen" << std::endl;
+        shutdown();
+        exit(1);
+      }
     }
+    freeaddrinfo(addr);
   }
 
   ~HttpServer() {
@@ -98,41 +162,111 @@ struct HttpServer {
 #endif
   }
 
+#ifdef __linux__
+  // edge-triggered event loops, one per listening socket: sockets never
+  // block, so a slow client only costs its own connection state. handlers
+  // run on the shared worker pool and their responses are handed back to
+  // the loop that owns the connection through its wakeup eventfd.
+  template <class RequestHandler>
+  void run(RequestHandler &&handler) {
+    m_handler = handler;
+    m_pool.reset(new ThreadPool(m_workers));
+    for (int sock : m_sockets) {
+      m_acceptors.emplace_back(new Acceptor{sock, m_ioUring});
+    }
+    if (m_ioUring && !m_acceptors[0]->loop.ioUring()) {
+      std::cerr << "[info] io_uring is not available, using epoll" << std::endl;
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < m_acceptors.size(); ++i) {
+      threads.emplace_back([this, i] { serve(*m_acceptors[i]); });
+    }
+    serve(*m_acceptors[0]);
+    for (auto &&thread : threads) thread.join();
+  }
+#else
   template <class RequestHandler>
   void run(RequestHandler &&handler) {
     sockaddr_in clientAddr;
     socklen_t clientAddrSize = sizeof(clientAddr);
     while (true) {
-      int client = accept(m_socket, (sockaddr *)&clientAddr, &clientAddrSize);
+      int client =
+          accept(m_sockets[0], (sockaddr *)&clientAddr, &clientAddrSize);
+      // a client that stops sending or reading must not hold up the loop
+#ifdef _WIN32
+      const DWORD timeout = HEADER_TIMEOUT * 1000;
+#else
+      const timeval timeout{HEADER_TIMEOUT, 0};
+#endif
+      setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout,
+                 sizeof(timeout));
+      setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout,
+                 sizeof(timeout));
       auto readData = std::string{};
+      auto parser = RequestParser{};
+      auto status = RequestParser::Status::Incomplete;
       char buffer[BUFFER_SIZE];
-      int bytesRead = recv(client, buffer, BUFFER_SIZE, 0);
+      while (status == RequestParser::Status::Incomplete) {
+        int bytesRead = recv(client, buffer, BUFFER_SIZE, 0);
+        if (bytesRead <= 0) break;
+        readData.append(buffer, bytesRead);
+        status = parser.parse(readData);
+      }
 
-      if (bytesRead < 0) {
+      if (status != RequestParser::Status::Complete) {
         closeConnection(client);
         continue;
       }
-      readData.append(buffer, bytesRead);
 
       // parse request
-      const auto request = parseRequest(client, readData);
+      const auto request = parser.take(readData);
 
       // handle request
-      const HttpResponse resp = handler(request);
+      HttpResponse resp = handler(request);
+      materialize(resp);
+      encodeBody(resp, contentCoding(request, resp));
 
       // send response
-      std::stringstream ss;
-      ss << resp.message << "\r\n";
-      ss << "Content-Length: " << resp.body.size() << "\r\n";
-      ss << "Content-Type: " << resp.mimetype << "\r\n";
-      ss << "\r\n";
-      ss << resp.body;
-      const auto response = ss.str();
-      send(client, response.c_str(), response.size(), 0);
+      auto header = std::string{};
+      appendHeader(header, resp, false);
+      send(client, header.c_str(), header.size(), 0);
+      if (!isNotModified(resp)) {
+        send(client, resp.body.c_str(), resp.body.size(), 0);
+      }
 
       closeConnection(client);
     }
   }
+#endif
+
+  // bodies of requests to path are streamed into a reader from factory
+  // as they arrive instead of being buffered whole.
+  void streamBody(const std::string &path, BodyReaderFactory factory) {
+    m_bodyReaders[path] = std::move(factory);
+  }
+
+  // upgrade requests to path become WebSocket connections whose messages
+  // go to a session from factory
+  void webSocket(const std::string &path, WebSocketSessionFactory factory) {
+    m_webSockets[path] = std::move(factory);
+  }
+
+  // runs task on a worker, for handlers that must not block the loop.
+  // without a worker pool it runs right away.
+  void submit(ThreadPool::Task task) {
+#ifdef __linux__
+    m_pool->submit(std::move(task));
+#else
+    task();
+#endif
+  }
+
+#ifdef __linux__
+  size_t workers() const { return m_pool->size(); }
+
+  // workers with nothing to do right now
+  size_t idleWorkers() const { return m_pool->idle(); }
+#endif
 
   void closeConnection(int socket) {
 #ifdef __linux__
@@ -142,8 +276,549 @@ struct HttpServer {
 #endif
   }
 
-  void shutdown() { closeConnection(m_socket); }
+  void shutdown() {
+    for (int sock : m_sockets) closeConnection(sock);
+  }
+
+  // the coding to send resp's body with. responses that may be compressed
+  // vary with Accept-Encoding, whichever coding this one gets.
+  ContentCoding contentCoding(const HttpRequest &request,
+                              HttpResponse &resp) const {
+    if (m_compressionLevel <= 0 || resp.file || isNotModified(resp) ||
+        !isCompressible(resp.mimetype) || hasField(resp, "Content-Encoding")) {
+      return ContentCoding::Identity;
+    }
+    if (!hasField(resp, "Vary")) {
+      resp.headers.emplace_back("Vary", "Accept-Encoding");
+    }
+    return negotiateEncoding(request.header);
+  }
+
+  // compresses a whole body if it is big enough to be worth it
+  void encodeBody(HttpResponse &resp, ContentCoding coding) const {
+    if (coding == ContentCoding::Identity ||
+        resp.body.size() < m_compressMinSize) {
+      return;
+    }
+    resp.body = compress(resp.body, coding, m_compressionLevel);
+    resp.headers.emplace_back("Content-Encoding", codingName(coding));
+  }
 
   bool m_shutdown;
-  int m_socket;
+  std::vector<int> m_sockets;  // listening sockets
+  size_t m_workers;
+  int m_keepAliveTimeout;  // seconds an idle connection is kept open
+  int m_headerTimeout;
+  int m_bodyTimeout;
+  int m_sendTimeout;
+  size_t m_maxRequests;    // requests served before a connection is closed
+  size_t m_maxBodySize;    // larger bodies are refused with 413
+  size_t m_maxQueued;
+  std::chrono::milliseconds m_latencyBudget;
+  int m_retryAfter;  // seconds a client is told to wait after a 503
+  int m_compressionLevel;
+  size_t m_compressMinSize;
+  bool m_ioUring;
+  std::map<std::string, BodyReaderFactory> m_bodyReaders;
+  std::map<std::string, WebSocketSessionFactory> m_webSockets;
+
+#ifdef __linux__
+ private:
+  // a handler's response, or with resume set, word that more of a
+  // chunked body is ready
+  struct Completion {
+    int fd;
+    uint64_t id;
+    HttpResponse response;
+    bool resume;
+  };
+
+  // a listening socket and the event loop serving the connections
+  // accepted from it
+  struct Acceptor {
+    Acceptor(int socket, bool ioUring)
+        : socket{socket},
+          loop{ioUring},
+          timers{},
+          connections{},
+          nextId{0},
+          wakeup{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+          completed{} {}
+
+    ~Acceptor() { close(wakeup); }
+
+    int socket;
+    EventLoop loop;
+    TimerWheel timers;  // outlives the connections whose timers it holds
+    std::unordered_map<int, Connection> connections;
+    uint64_t nextId;
+    int wakeup;
+    std::mutex completedMutex;
+    std::vector<Completion> completed;
+  };
+
+  void serve(Acceptor &acceptor) {
+    acceptor.loop.add(acceptor.wakeup, EPOLLIN | EPOLLET);
+    setNonBlocking(acceptor.socket);
+    acceptor.loop.listen(acceptor.socket);
+    while (true) {
+      const int timeout =
+          acceptor.timers.timeout(std::chrono::steady_clock::now());
+      acceptor.loop.poll(
+          timeout,
+          [&](int fd, uint32_t events) { onEvent(acceptor, fd, events); },
+          [&](int client) { addConnection(acceptor, client); });
+      acceptor.timers.advance(
+          std::chrono::steady_clock::now(),
+          [&](TimerWheel::Timer &timer) { onTimeout(acceptor, timer.key); });
+    }
+  }
+
+  void onEvent(Acceptor &acceptor, int fd, uint32_t events) {
+    if (fd == acceptor.socket) {
+      acceptConnections(acceptor);
+      return;
+    }
+    if (fd == acceptor.wakeup) {
+      completeResponses(acceptor);
+      return;
+    }
+    auto &connections = acceptor.connections;
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+    auto &conn = it->second;
+    if (events & (EPOLLERR | EPOLLHUP)) {
+      dropConnection(acceptor, conn);
+      return;
+    }
+    if (events & EPOLLIN) onReadable(acceptor, conn);
+    // reading may have closed the connection
+    it = connections.find(fd);
+    if (it == connections.end()) return;
+    if (events & EPOLLOUT) onWritable(acceptor, it->second);
+  }
+
+  static void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  }
+
+  void acceptConnections(Acceptor &acceptor) {
+    while (true) {
+      int client = accept4(acceptor.socket, nullptr, nullptr, SOCK_NONBLOCK);
+      if (client < 0) {
+        if (errno == EINTR) continue;
+        return;  // EAGAIN: backlog drained
+      }
+      addConnection(acceptor, client);
+    }
+  }
+
+  void addConnection(Acceptor &acceptor, int client) {
+    auto &conn =
+        acceptor.connections
+            .emplace(client,
+                     Connection{client, acceptor.nextId++, m_maxBodySize})
+            .first->second;
+    acceptor.loop.add(client, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+    armReadTimer(acceptor, conn);
+  }
+
+  // reads at most a request's worth at a time and handles it before
+  // reading on. a busy connection leaves what follows in the socket, so a
+  // client pipelining requests faster than it reads the responses is held
+  // back by TCP instead of filling inbuf.
+  void onReadable(Acceptor &acceptor, Connection &conn) {
+    const int fd = conn.fd;
+    const size_t limit = MAX_HEADER_SIZE + m_maxBodySize + 1;
+    while (conn.state == Connection::State::Reading ||
+           (conn.state == Connection::State::WebSocket &&
+            !conn.socket->closed())) {
+      if (!conn.receive(limit)) conn.peerClosed = true;
+      const bool full = conn.inbuf.size() >= limit;
+      if (conn.state == Connection::State::WebSocket) {
+        processFrames(acceptor, conn);
+      } else {
+        processNext(acceptor, conn);
+      }
+      // handling it may have closed the connection
+      if (!full ||
+          acceptor.connections.find(fd) == acceptor.connections.end()) {
+        return;
+      }
+      if (conn.inbuf.size() >= limit) {
+        // no request or frame that fits the limits is that long
+        dropConnection(acceptor, conn);
+        return;
+      }
+    }
+  }
+
+  // requests are answered one at a time in arrival order, so pipelined
+  // requests wait in inbuf or the socket until the previous response has
+  // been written.
+  void processNext(Acceptor &acceptor, Connection &conn) {
+    if (conn.state != Connection::State::Reading) return;
+    const auto status = conn.parser.parse(conn.inbuf);
+    if (status == RequestParser::Status::Malformed) {
+      reject(acceptor, conn,
+             HttpResponse{"HTTP/1.1 400 Bad Request", "text/html",
+                          "400 Bad Request"});
+      return;
+    }
+    if (status == RequestParser::Status::TooLarge) {
+      // rejected from the header alone, the body is never read
+      reject(acceptor, conn,
+             HttpResponse{"HTTP/1.1 413 Payload Too Large", "text/html",
+                          "413 Payload Too Large"});
+      return;
+    }
+
+    if (conn.parser.headerComplete()) {
+      if (!conn.reader && conn.parser.contentLength() > 0) {
+        auto it = m_bodyReaders.find(std::string{conn.parser.path(conn.inbuf)});
+        if (it != m_bodyReaders.end()) {
+          conn.reader = it->second(conn.parser.contentLength());
+        }
+      }
+      if (conn.reader) conn.parser.consumeBody(conn.inbuf, *conn.reader);
+    }
+
+    if (status == RequestParser::Status::Incomplete) {
+      if (conn.peerClosed) {
+        dropConnection(acceptor, conn);
+        return;
+      }
+      armReadTimer(acceptor, conn);
+      return;
+    }
+
+    conn.timer.cancel();
+    conn.requestStart = {};
+    auto request = conn.parser.take(conn.inbuf);
+    request.reader = std::move(conn.reader);
+    if (isWebSocketUpgrade(request.header)) {
+      auto it = m_webSockets.find(std::string{request.header.path});
+      if (it != m_webSockets.end()) {
+        upgrade(acceptor, conn, request, it->second);
+        return;
+      }
+    }
+    if (overloaded()) {
+      reject(acceptor, conn, unavailable());
+      return;
+    }
+    conn.state = Connection::State::Processing;
+    conn.keepAlive =
+        wantsKeepAlive(request) && ++conn.requests < m_maxRequests;
+    const int fd = conn.fd;
+    const uint64_t id = conn.id;
+    const auto queuedAt = std::chrono::steady_clock::now();
+    conn.body = std::make_shared<ChunkedBody>();
+    ++m_queued;
+    m_pool->submit([this, &acceptor, fd, id, queuedAt, body = conn.body,
+                    request = std::move(request)] {
+      --m_queued;
+      const auto waited = std::chrono::steady_clock::now() - queuedAt;
+      recordQueueDelay(waited);
+      if (waited > m_latencyBudget) {
+        // the client has likely given up, don't spend a render on it
+        complete(acceptor, Completion{fd, id, unavailable(), false});
+        return;
+      }
+      if (body->cancelled()) return;  // the client is gone
+      HttpResponse resp = m_handler(request);
+      if (request.header.version == "HTTP/1.0") materialize(resp);
+      const auto coding = contentCoding(request, resp);
+      auto stream = std::move(resp.stream);
+      resp.stream = nullptr;
+      if (!stream) {
+        encodeBody(resp, coding);
+        complete(acceptor, Completion{fd, id, std::move(resp), false});
+        return;
+      }
+
+      // render the body into chunks behind the header
+      if (body->cancelled()) return;
+      resp.chunks = body;
+      ChunkedStreamBuf buffer(
+          resp.chunks, [this, &acceptor, fd, id] {
+            complete(acceptor, Completion{fd, id, {}, true});
+          });
+      if (coding == ContentCoding::Identity) {
+        complete(acceptor, Completion{fd, id, std::move(resp), false});
+      } else {
+        // the header waits until the body is known to be worth compressing
+        buffer.hold(m_compressMinSize, [&](std::string *whole) {
+          if (whole) {
+            resp.chunks = nullptr;
+            resp.body = std::move(*whole);
+            encodeBody(resp, coding);
+          } else {
+            auto deflater =
+                std::make_shared<Deflater>(coding, m_compressionLevel);
+            buffer.encode([deflater](std::string_view data, bool last) {
+              return (*deflater)(data, last);
+            });
+            resp.headers.emplace_back("Content-Encoding", codingName(coding));
+          }
+          complete(acceptor, Completion{fd, id, std::move(resp), false});
+        });
+      }
+      std::ostream ost(&buffer);
+      stream(ost);
+      buffer.close();
+    });
+  }
+
+  // answers the handshake; the connection switches to frames once the
+  // 101 response has been written
+  void upgrade(Acceptor &acceptor, Connection &conn,
+               const HttpRequest &request,
+               const WebSocketSessionFactory &factory) {
+    const int fd = conn.fd;
+    const uint64_t id = conn.id;
+    conn.socket = std::make_shared<WebSocket>(
+        [this, &acceptor, fd, id] {
+          complete(acceptor, Completion{fd, id, {}, true});
+        });
+    conn.session = factory(conn.socket);
+    auto resp = HttpResponse{"HTTP/1.1 101 Switching Protocols", "", ""};
+    resp.headers.emplace_back("Upgrade", "websocket");
+    resp.headers.emplace_back("Connection", "Upgrade");
+    resp.headers.emplace_back(
+        "Sec-WebSocket-Accept",
+        webSocketAccept(valueOf(request.header, "Sec-WebSocket-Key")));
+    conn.keepAlive = true;
+    respond(acceptor, conn, std::move(resp));
+  }
+
+  // decodes the frames in inbuf and hands complete messages to the pool
+  void processFrames(Acceptor &acceptor, Connection &conn) {
+    WebSocketFrame frame;
+    size_t consumed = 0;
+    while (!conn.socket->closed()) {
+      const auto view = std::string_view{conn.inbuf}.substr(consumed);
+      const auto n = parseFrame(view, frame, m_maxBodySize);
+      if (n == 0) break;
+      if (n < 0) {
+        conn.socket->close();
+        break;
+      }
+      consumed += n;
+
+      switch (frame.opcode) {
+        case WebSocketOpcode::Ping:
+          conn.socket->enqueue(makeFrame(WebSocketOpcode::Pong, frame.payload));
+          continue;
+        case WebSocketOpcode::Pong:
+          continue;
+        case WebSocketOpcode::Close:
+          conn.socket->close();
+          continue;
+        case WebSocketOpcode::Continuation:
+          conn.message += frame.payload;
+          break;
+        case WebSocketOpcode::Text:
+        case WebSocketOpcode::Binary:
+          conn.message = std::move(frame.payload);
+          break;
+        default:
+          conn.socket->close();
+          continue;
+      }
+      if (conn.message.size() > m_maxBodySize) {
+        conn.socket->close();
+        continue;
+      }
+      if (!frame.fin) continue;
+
+      conn.session->onMessage(std::move(conn.message));
+      conn.message = std::string{};
+    }
+    conn.inbuf.erase(0, consumed);
+    if (conn.peerClosed) {
+      dropConnection(acceptor, conn);
+      return;
+    }
+    writeFrames(acceptor, conn);
+  }
+
+  void writeFrames(Acceptor &acceptor, Connection &conn) {
+    while (true) {
+      if (conn.frameSent == conn.frame.size()) {
+        conn.frameSent = 0;
+        if (!conn.socket->pop(conn.frame)) {
+          conn.frame.clear();
+          conn.timer.cancel();
+          if (conn.socket->closed()) dropConnection(acceptor, conn);
+          return;
+        }
+      }
+      ssize_t n = send(conn.fd, conn.frame.data() + conn.frameSent,
+                       conn.frame.size() - conn.frameSent, MSG_NOSIGNAL);
+      if (n >= 0) {
+        conn.frameSent += n;
+        continue;
+      }
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        dropConnection(acceptor, conn);
+        return;
+      }
+      armSendTimer(acceptor, conn);
+      return;
+    }
+  }
+
+  // called on workers: hands a completion to the loop thread
+  void complete(Acceptor &acceptor, Completion &&completion) {
+    {
+      std::lock_guard<std::mutex> lock(acceptor.completedMutex);
+      acceptor.completed.push_back(std::move(completion));
+    }
+    const uint64_t one = 1;
+    write(acceptor.wakeup, &one, sizeof(one));
+  }
+
+  // true while new requests should be turned away: too many are waiting,
+  // or the ones that got a worker recently had waited past the budget
+  bool overloaded() const {
+    const size_t queued = m_queued;
+    if (queued >= m_maxQueued) return true;
+    return queued > 0 && std::chrono::microseconds(m_queueDelay) >
+                             m_latencyBudget;
+  }
+
+  // keeps a moving average of how long requests wait for a worker
+  void recordQueueDelay(std::chrono::steady_clock::duration waited) {
+    const long long sample =
+        std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+    const long long average = m_queueDelay;
+    m_queueDelay = average + (sample - average) / 8;
+  }
+
+  HttpResponse unavailable() const {
+    auto resp = HttpResponse{"HTTP/1.1 503 Service Unavailable", "text/html",
+                             "503 Service Unavailable"};
+    resp.headers.emplace_back("Retry-After", std::to_string(m_retryAfter));
+    return resp;
+  }
+
+  // answers with resp and closes the connection once it is written
+  void reject(Acceptor &acceptor, Connection &conn, HttpResponse &&resp) {
+    conn.keepAlive = false;
+    respond(acceptor, conn, std::move(resp));
+  }
+
+  void respond(Acceptor &acceptor, Connection &conn, HttpResponse &&resp) {
+    conn.writer.start(std::move(resp), conn.keepAlive);
+    conn.state = Connection::State::Writing;
+    onWritable(acceptor, conn);
+  }
+
+  void completeResponses(Acceptor &acceptor) {
+    uint64_t count;
+    while (read(acceptor.wakeup, &count, sizeof(count)) > 0) {
+    }
+    std::vector<Completion> completed;
+    {
+      std::lock_guard<std::mutex> lock(acceptor.completedMutex);
+      completed.swap(acceptor.completed);
+    }
+    for (auto &&completion : completed) {
+      auto it = acceptor.connections.find(completion.fd);
+      if (it == acceptor.connections.end()) continue;
+      auto &conn = it->second;
+      if (conn.id != completion.id) continue;
+      if (completion.resume) {
+        onWritable(acceptor, conn);
+      } else {
+        respond(acceptor, conn, std::move(completion.response));
+      }
+    }
+  }
+
+  void onWritable(Acceptor &acceptor, Connection &conn) {
+    if (conn.state == Connection::State::WebSocket) {
+      writeFrames(acceptor, conn);
+      return;
+    }
+    if (conn.state != Connection::State::Writing) return;
+    const auto result = conn.writer.write(conn.fd);
+    if (result == ResponseWriter::Result::Blocked) {
+      armSendTimer(acceptor, conn);
+      return;
+    }
+    if (result == ResponseWriter::Result::Pending) {
+      conn.timer.cancel();  // waiting on the worker, not the client
+      return;
+    }
+    if (result == ResponseWriter::Result::Failed || !conn.keepAlive) {
+      dropConnection(acceptor, conn);
+      return;
+    }
+    conn.writer.finish();
+    conn.body = nullptr;
+    conn.timer.cancel();
+    conn.state = conn.socket ? Connection::State::WebSocket
+                             : Connection::State::Reading;
+    // picks up what arrived while the connection was busy
+    onReadable(acceptor, conn);
+  }
+
+  // while a request is read: the whole header has to arrive within the
+  // header timeout of its first byte, and a body must not stall for longer
+  // than the body timeout. between requests, the idle timeout applies.
+  void armReadTimer(Acceptor &acceptor, Connection &conn) {
+    const auto now = std::chrono::steady_clock::now();
+    auto deadline = now + std::chrono::seconds(m_keepAliveTimeout);
+    if (conn.parser.headerComplete()) {
+      deadline = now + std::chrono::seconds(m_bodyTimeout);
+    } else if (!conn.inbuf.empty()) {
+      if (conn.requestStart == std::chrono::steady_clock::time_point{}) {
+        conn.requestStart = now;
+      }
+      deadline = conn.requestStart + std::chrono::seconds(m_headerTimeout);
+    } else if (conn.timer.scheduled()) {
+      return;  // already idle, a wakeup without data doesn't extend it
+    }
+    acceptor.timers.schedule(conn.timer, deadline);
+  }
+
+  // a client that stops taking the response is given up on
+  void armSendTimer(Acceptor &acceptor, Connection &conn) {
+    const auto now = std::chrono::steady_clock::now();
+    acceptor.timers.schedule(conn.timer,
+                             now + std::chrono::seconds(m_sendTimeout));
+  }
+
+  void onTimeout(Acceptor &acceptor, int fd) {
+    auto it = acceptor.connections.find(fd);
+    if (it == acceptor.connections.end()) return;
+    auto &conn = it->second;
+    if (conn.state == Connection::State::Reading && !conn.inbuf.empty()) {
+      reject(acceptor, conn,
+             HttpResponse{"HTTP/1.1 408 Request Timeout", "text/html",
+                          "408 Request Timeout"});
+      return;
+    }
+    dropConnection(acceptor, conn);
+  }
+
+  void dropConnection(Acceptor &acceptor, Connection &conn) {
+    conn.writer.cancel();
+    if (conn.body) conn.body->cancel();
+    if (conn.socket) conn.socket->detach();
+    const int fd = conn.fd;
+    acceptor.loop.remove(fd);
+    closeConnection(fd);
+    acceptor.connections.erase(fd);
+  }
+
+  std::function<HttpResponse(const HttpRequest &)> m_handler;
+  std::unique_ptr<ThreadPool> m_pool;
+  std::vector<std::unique_ptr<Acceptor>> m_acceptors;
+  std::atomic<size_t> m_queued{0};  // requests waiting for a worker
+  std::atomic<long long> m_queueDelay{0};  // microseconds, moving average
+#endif
 };
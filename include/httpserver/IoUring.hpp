@@ -0,0 +1,196 @@
+#pragma once
+
+#if defined(__linux__) && defined(HAVE_IO_URING)
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>  // for close
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+const unsigned IO_URING_ENTRIES = 256;
+
+// a submission and completion queue shared with the kernel, driven with
+// the raw system calls so nothing beyond the kernel headers is needed.
+// everything queued since the last wait goes to the kernel with the wait
+// itself, one io_uring_enter for a whole turn of the loop.
+class IoUring {
+ public:
+  IoUring()
+      : m_fd{-1},
+        m_features{0},
+        m_sqRing{nullptr},
+        m_cqRing{nullptr},
+        m_sqRingSize{0},
+        m_cqRingSize{0},
+        m_sqes{nullptr},
+        m_sqesSize{0},
+        m_pending{0},
+        m_ops{} {}
+
+  ~IoUring() {
+    if (m_sqes) munmap(m_sqes, m_sqesSize);
+    if (m_cqRing && m_cqRing != m_sqRing) munmap(m_cqRing, m_cqRingSize);
+    if (m_sqRing) munmap(m_sqRing, m_sqRingSize);
+    if (m_fd >= 0) close(m_fd);
+  }
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  // false if the kernel has no io_uring, refuses it, or lacks waiting
+  // with a timeout (5.11)
+  bool init(unsigned entries = IO_URING_ENTRIES) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // leave room for a burst of completions between two waits
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    m_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (m_fd < 0) return false;
+    m_features = params.features;
+    if (!(m_features & IORING_FEAT_EXT_ARG) ||
+        !(m_features & IORING_FEAT_NODROP)) {
+      return false;
+    }
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (m_features & IORING_FEAT_SINGLE_MMAP) {
+      m_sqRingSize = m_cqRingSize =
+          m_sqRingSize > m_cqRingSize ? m_sqRingSize : m_cqRingSize;
+    }
+    m_sqRing = map(m_sqRingSize, IORING_OFF_SQ_RING);
+    if (!m_sqRing) return false;
+    m_cqRing = m_features & IORING_FEAT_SINGLE_MMAP
+                   ? m_sqRing
+                   : map(m_cqRingSize, IORING_OFF_CQ_RING);
+    if (!m_cqRing) return false;
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe *>(map(m_sqesSize, IORING_OFF_SQES));
+    if (!m_sqes) return false;
+
+    auto *sq = static_cast<char *>(m_sqRing);
+    m_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    m_sqEntries = params.sq_entries;
+    m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto *cq = static_cast<char *>(m_cqRing);
+    m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    probe();
+    return true;
+  }
+
+  unsigned features() const { return m_features; }
+
+  bool supports(int op) const {
+    return op < static_cast<int>(m_ops.size()) && m_ops[op];
+  }
+
+  // the next free submission entry, cleared. submits what is queued first
+  // if the queue is full.
+  io_uring_sqe &next() {
+    if (m_pending == m_sqEntries) submit(0, 0, nullptr);
+    const unsigned tail = *m_sqTail;
+    const unsigned index = tail & m_sqMask;
+    io_uring_sqe &sqe = m_sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    m_sqArray[index] = index;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++m_pending;
+    return sqe;
+  }
+
+  // submits what is queued and waits up to timeoutMs (-1 forever) for a
+  // completion, then moves every completion into out
+  void wait(int timeoutMs, std::vector<io_uring_cqe> &out) {
+    __kernel_timespec ts{};
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+    io_uring_getevents_arg arg{};
+    arg.ts = timeoutMs < 0 ? 0 : reinterpret_cast<uint64_t>(&ts);
+    out.clear();
+    if (!ready()) {
+      submit(timeoutMs == 0 ? 0 : 1, IORING_ENTER_GETEVENTS, &arg);
+    } else if (m_pending) {
+      submit(0, 0, nullptr);
+    }
+
+    unsigned head = *m_cqHead;
+    const unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) out.push_back(m_cqes[head & m_cqMask]);
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+  }
+
+ private:
+  void *map(size_t size, off_t offset) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_fd, offset);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  // which operations this kernel knows
+  void probe() {
+    const size_t count = IORING_OP_LAST;
+    std::vector<char> buffer(sizeof(io_uring_probe) +
+                             count * sizeof(io_uring_probe_op));
+    auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+    if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe,
+                count) < 0) {
+      return;
+    }
+    m_ops.assign(probe->ops_len, false);
+    for (unsigned i = 0; i < probe->ops_len; ++i) {
+      m_ops[i] = probe->ops[i].flags & IO_URING_OP_SUPPORTED;
+    }
+  }
+
+  bool ready() const {
+    return *m_cqHead != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+  }
+
+  void submit(unsigned waitFor, unsigned flags, io_uring_getevents_arg *arg) {
+    if (arg) flags |= IORING_ENTER_EXT_ARG;
+    while (true) {
+      const long n =
+          syscall(__NR_io_uring_enter, m_fd, m_pending, waitFor, flags, arg,
+                  arg ? sizeof(*arg) : 0);
+      const int error = errno;
+      m_pending = *m_sqTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+      // ETIME: the wait ran out. EBUSY: completions must be reaped first
+      if (n >= 0 || error != EINTR || m_pending == 0) return;
+    }
+  }
+
+  int m_fd;
+  unsigned m_features;
+  void *m_sqRing;
+  void *m_cqRing;
+  size_t m_sqRingSize;
+  size_t m_cqRingSize;
+  io_uring_sqe *m_sqes;
+  size_t m_sqesSize;
+  unsigned *m_sqHead;
+  unsigned *m_sqTail;
+  unsigned m_sqMask;
+  unsigned m_sqEntries;
+  unsigned *m_sqArray;
+  unsigned *m_cqHead;
+  unsigned *m_cqTail;
+  unsigned m_cqMask;
+  io_uring_cqe *m_cqes;
+  unsigned m_pending;  // queued entries the kernel hasn't taken yet
+  std::vector<bool> m_ops;
+};
+
+#endif
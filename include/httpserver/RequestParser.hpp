@@ -0,0 +1,213 @@
+#pragma once
+
+#include <BodyReader.hpp>
+#include <HttpRequest.hpp>
+#include <algorithm>
+#include <common/StringUtils.hpp>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+const size_t MAX_HEADER_SIZE = 64 * 1024;
+const size_t MAX_BODY_SIZE = 16 * 1024 * 1024;
+
+// resumable HTTP/1.x request parser.
+// the receive buffer may grow (and move) between calls to parse(), so
+// positions are kept as offsets and only turned into views by take().
+class RequestParser {
+ public:
+  enum class Status { Incomplete, Complete, Malformed, TooLarge };
+
+  explicit RequestParser(size_t maxBodySize = MAX_BODY_SIZE)
+      : m_maxBodySize{maxBodySize} {
+    reset();
+  }
+
+  void reset() {
+    m_state = State::RequestLine;
+    m_lineBegin = 0;
+    m_scanned = 0;
+    m_bodyBegin = 0;
+    m_contentLength = 0;
+    m_bodyConsumed = 0;
+    m_method = m_path = m_version = Span{};
+    m_fields.clear();
+  }
+
+  // continues parsing buffer from where the previous call stopped
+  Status parse(std::string_view buffer) {
+    while (m_state == State::RequestLine || m_state == State::Headers) {
+      const auto eol = buffer.find('\n', m_scanned);
+      if (eol == std::string_view::npos) {
+        if (buffer.size() > MAX_HEADER_SIZE) return fail();
+        m_scanned = buffer.size();
+        return Status::Incomplete;
+      }
+      // many short lines must not get past the limit either
+      if (eol + 1 > MAX_HEADER_SIZE) return fail();
+      auto line = buffer.substr(m_lineBegin, eol - m_lineBegin);
+      if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+      const size_t offset = m_lineBegin;
+      m_lineBegin = m_scanned = eol + 1;
+
+      const bool ok = m_state == State::RequestLine
+                          ? parseRequestLine(line, offset)
+                          : parseHeaderLine(line, offset);
+      if (!ok) return fail();
+    }
+    if (m_state == State::Error) return Status::Malformed;
+    if (m_state == State::TooLarge) return Status::TooLarge;
+    if (buffer.size() - m_bodyBegin < bodyRemaining()) {
+      return Status::Incomplete;
+    }
+    return Status::Complete;
+  }
+
+  // true once the header has been parsed and only body bytes are missing
+  bool headerComplete() const { return m_state == State::Body; }
+
+  size_t contentLength() const { return m_contentLength; }
+
+  std::string_view path(std::string_view buffer) const {
+    return buffer.substr(m_path.offset, m_path.length);
+  }
+
+  // passes the body bytes received so far to reader and drops them from
+  // buffer, so a streamed body is never held in the receive buffer.
+  void consumeBody(std::string &buffer, BodyReader &reader) {
+    if (!headerComplete()) return;
+    const size_t n = std::min(buffer.size() - m_bodyBegin, bodyRemaining());
+    if (n == 0) return;
+    reader.read(std::string_view{buffer}.substr(m_bodyBegin, n));
+    buffer.erase(m_bodyBegin, n);
+    m_bodyConsumed += n;
+  }
+
+  // total size of the completed request still held in the buffer
+  size_t size() const { return m_bodyBegin + bodyRemaining(); }
+
+  // moves the completed request out of the front of buffer
+  HttpRequest take(std::string &buffer) {
+    HttpRequest request;
+    const size_t n = size();
+    if (n == buffer.size()) {
+      request.raw = std::move(buffer);
+      buffer.clear();
+    } else {
+      request.raw.assign(buffer, 0, n);
+      buffer.erase(0, n);
+    }
+    request.header.method = view(request, m_method);
+    request.header.path = view(request, m_path);
+    request.header.version = view(request, m_version);
+    for (auto &&field : m_fields) {
+      request.header.headers.emplace_back(view(request, field.name),
+                                          view(request, field.value));
+    }
+    request.body = view(request, Span{m_bodyBegin, bodyRemaining()});
+    reset();
+    return request;
+  }
+
+ private:
+  enum class State { RequestLine, Headers, Body, Error, TooLarge };
+
+  struct Span {
+    size_t offset = 0;
+    size_t length = 0;
+  };
+
+  struct Field {
+    Span name;
+    Span value;
+  };
+
+  static std::string_view view(const HttpRequest &request, Span span) {
+    return std::string_view{request.raw}.substr(span.offset, span.length);
+  }
+
+  static bool isToken(std::string_view s) {
+    if (s.empty()) return false;
+    for (char c : s) {
+      if (isLetter(c)) continue;
+      if (std::string_view{"!#$%&'*+-.^`|~"}.find(c) == std::string_view::npos)
+        return false;
+    }
+    return true;
+  }
+
+  size_t bodyRemaining() const { return m_contentLength - m_bodyConsumed; }
+
+  Status fail() {
+    m_state = State::Error;
+    return Status::Malformed;
+  }
+
+  // METHOD SP TARGET SP VERSION
+  bool parseRequestLine(std::string_view line, size_t offset) {
+    if (line.empty()) return true;  // tolerate leading blank lines
+    const auto sp1 = line.find(' ');
+    if (sp1 == std::string_view::npos) return false;
+    const auto sp2 = line.find(' ', sp1 + 1);
+    if (sp2 == std::string_view::npos) return false;
+    if (line.find(' ', sp2 + 1) != std::string_view::npos) return false;
+
+    const auto method = line.substr(0, sp1);
+    const auto path = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    const auto version = line.substr(sp2 + 1);
+    if (!isToken(method) || path.empty()) return false;
+    if (version.substr(0, 5) != "HTTP/") return false;
+
+    m_method = Span{offset, method.size()};
+    m_path = Span{offset + sp1 + 1, path.size()};
+    m_version = Span{offset + sp2 + 1, version.size()};
+    m_state = State::Headers;
+    return true;
+  }
+
+  // NAME ":" OWS VALUE OWS, or the empty line ending the header
+  bool parseHeaderLine(std::string_view line, size_t offset) {
+    if (line.empty()) {
+      m_bodyBegin = m_lineBegin;
+      m_state =
+          m_contentLength > m_maxBodySize ? State::TooLarge : State::Body;
+      return true;
+    }
+    const auto colon = line.find(':');
+    if (colon == std::string_view::npos) return false;
+    const auto name = line.substr(0, colon);
+    if (!isToken(name)) return false;
+
+    size_t first = colon + 1, last = line.size();
+    while (first < last && isSpace(line[first])) ++first;
+    while (last > first && isSpace(line[last - 1])) --last;
+    const auto value = line.substr(first, last - first);
+
+    if (equalsIgnoreCase(name, "Content-Length")) {
+      if (value.empty() || value.size() > 18) return false;
+      size_t length = 0;
+      for (char c : value) {
+        if (!isDigit(c)) return false;
+        length = length * 10 + (c - '0');
+      }
+      m_contentLength = length;
+    }
+
+    m_fields.push_back(Field{Span{offset, name.size()},
+                             Span{offset + first, value.size()}});
+    return true;
+  }
+
+  size_t m_maxBodySize;
+  State m_state;
+  size_t m_lineBegin;  // where the next unparsed header line starts
+  size_t m_scanned;    // bytes already searched for a line end
+  size_t m_bodyBegin;
+  size_t m_contentLength;
+  size_t m_bodyConsumed;  // body bytes already handed to a BodyReader
+  Span m_method;
+  Span m_path;
+  Span m_version;
+  std::vector<Field> m_fields;
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <HttpResponse.hpp>
+#include <common/StringUtils.hpp>
+#include <cstddef>
+#include <string>
+
+const int KEEP_ALIVE_TIMEOUT = 5;  // seconds
+const size_t MAX_KEEP_ALIVE_REQUESTS = 100;
+
+// a 304 has no body, so it must not announce the length of one
+bool isNotModified(const HttpResponse &resp) {
+  return contains(resp.message, " 304 ");
+}
+
+bool isSwitchingProtocols(const HttpResponse &resp) {
+  return contains(resp.message, " 101 ");
+}
+
+bool hasField(const HttpResponse &resp, const std::string &name) {
+  for (auto &&field : resp.headers) {
+    if (equalsIgnoreCase(field.first, name)) return true;
+  }
+  return false;
+}
+
+// appends the status line and header fields of resp to out
+void appendHeader(std::string &out, const HttpResponse &resp, bool keepAlive) {
+  out += resp.message;
+  out += "\r\n";
+  if (resp.chunks) {
+    out += "Transfer-Encoding: chunked\r\nContent-Type: ";
+    out += resp.mimetype;
+    out += "\r\n";
+  } else if (!isNotModified(resp) && !isSwitchingProtocols(resp)) {
+    const size_t length = resp.file ? resp.file->size : resp.body.size();
+    out += "Content-Length: ";
+    out += std::to_string(length);
+    out += "\r\nContent-Type: ";
+    out += resp.mimetype;
+    out += "\r\n";
+  }
+  for (auto &&field : resp.headers) {
+    out += field.first;
+    out += ": ";
+    out += field.second;
+    out += "\r\n";
+  }
+  if (hasField(resp, "Connection")) {
+    // set by the handler, e.g. for an upgrade
+  } else if (keepAlive) {
+    out += "Connection: keep-alive\r\nKeep-Alive: timeout=";
+    out += std::to_string(KEEP_ALIVE_TIMEOUT);
+    out += ", max=";
+    out += std::to_string(MAX_KEEP_ALIVE_REQUESTS);
+    out += "\r\n";
+  } else {
+    out += "Connection: close\r\n";
+  }
+  out += "\r\n";
+}
+
+#ifdef __linux__
+
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <cerrno>
+#include <utility>
+
+// writes one response to a non-blocking socket: the header and body are
+// gathered into a single sendmsg, a file body follows with sendfile and
+// a chunked body is framed and sent chunk by chunk as it is produced.
+// the header buffer keeps its capacity across responses on a connection.
+struct ResponseWriter {
+  // Pending: everything produced so far is sent, the body isn't complete
+  enum class Result { Done, Blocked, Pending, Failed };
+
+  ResponseWriter()
+      : header{},
+        response{},
+        sent{0},
+        fileSent{0},
+        chunkHeader{},
+        chunk{},
+        chunkSent{0},
+        lastChunk{false} {}
+
+  void start(HttpResponse &&resp, bool keepAlive) {
+    header.clear();
+    appendHeader(header, resp, keepAlive);
+    response = std::move(resp);
+    if (response.file || response.chunks || isNotModified(response)) {
+      response.body.clear();
+    }
+    sent = 0;
+    fileSent = 0;
+    chunkHeader.clear();
+    chunk.clear();
+    chunkSent = 0;
+    lastChunk = false;
+  }
+
+  // releases the body once it has been written
+  void finish() {
+    response = HttpResponse{};
+    chunk = std::string{};
+  }
+
+  // stops a chunked body nobody is going to receive
+  void cancel() {
+    if (response.chunks) response.chunks->cancel();
+  }
+
+  Result write(int fd) {
+    const size_t total = header.size() + response.body.size();
+    while (sent < total) {
+      iovec iov[2];
+      int count = 0;
+      if (sent < header.size()) {
+        iov[count].iov_base = &header[sent];
+        iov[count].iov_len = header.size() - sent;
+        ++count;
+      }
+      const size_t bodySent = sent < header.size() ? 0 : sent - header.size();
+      if (bodySent < response.body.size()) {
+        iov[count].iov_base = &response.body[bodySent];
+        iov[count].iov_len = response.body.size() - bodySent;
+        ++count;
+      }
+      msghdr msg{};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = count;
+      ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+      if (n >= 0) {
+        sent += n;
+        continue;
+      }
+      if (errno == EINTR) continue;
+      return blockedOrFailed();
+    }
+    const auto &file = response.file;
+    while (file && fileSent < file->size) {
+      off_t offset = fileSent;
+      ssize_t n = sendfile(fd, file->fd, &offset, file->size - fileSent);
+      if (n > 0) {
+        fileSent += n;
+        continue;
+      }
+      if (n == 0) return Result::Failed;  // file shrank underneath us
+      if (errno == EINTR) continue;
+      return blockedOrFailed();
+    }
+    if (response.chunks) return writeChunks(fd);
+    return Result::Done;
+  }
+
+  std::string header;
+  HttpResponse response;
+  size_t sent;  // bytes of header and body written so far
+  size_t fileSent;
+  std::string chunkHeader;  // hex size line of the chunk being sent
+  std::string chunk;
+  size_t chunkSent;  // bytes of the framed chunk written so far
+  bool lastChunk;    // the zero-size chunk ending the body was started
+
+ private:
+  // frames each chunk as SIZE CRLF DATA CRLF; an empty chunk ends the body
+  Result writeChunks(int fd) {
+    static const char crlf[] = "\r\n";
+    while (true) {
+      const size_t framed = chunkHeader.size() + chunk.size() + 2;
+      if (chunkHeader.empty() || chunkSent == framed) {
+        if (lastChunk) return Result::Done;
+        if (response.chunks->pop(chunk)) {
+          chunkHeader = toHex(chunk.size()) + "\r\n";
+        } else if (response.chunks->drained()) {
+          chunk.clear();
+          chunkHeader = "0\r\n";
+          lastChunk = true;
+        } else {
+          return Result::Pending;
+        }
+        chunkSent = 0;
+        continue;
+      }
+
+      iovec iov[3];
+      int count = 0;
+      size_t skip = chunkSent;
+      const std::pair<const char *, size_t> parts[] = {
+          {chunkHeader.data(), chunkHeader.size()},
+          {chunk.data(), chunk.size()},
+          {crlf, 2}};
+      for (auto &&part : parts) {
+        if (skip >= part.second) {
+          skip -= part.second;
+          continue;
+        }
+        iov[count].iov_base = const_cast<char *>(part.first + skip);
+        iov[count].iov_len = part.second - skip;
+        skip = 0;
+        ++count;
+      }
+      msghdr msg{};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = count;
+      ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+      if (n >= 0) {
+        chunkSent += n;
+        continue;
+      }
+      if (errno == EINTR) continue;
+      return blockedOrFailed();
+    }
+  }
+
+  static std::string toHex(size_t n) {
+    static const char digits[] = "0123456789abcdef";
+    auto ret = std::string{};
+    do {
+      ret.insert(ret.begin(), digits[n & 0xf]);
+      n >>= 4;
+    } while (n != 0);
+    return ret;
+  }
+
+  static Result blockedOrFailed() {
+    return errno == EAGAIN || errno == EWOULDBLOCK ? Result::Blocked
+                                                   : Result::Failed;
+  }
+};
+
+#endif
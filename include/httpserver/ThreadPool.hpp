@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed-size pool where every worker owns a task queue.
+// idle workers steal from the other end of their neighbours' queues,
+// so one long task never holds up the tasks queued behind it.
+class ThreadPool {
+ public:
+  using Task = std::function<void()>;
+
+  explicit ThreadPool(size_t size)
+      : m_queues{},
+        m_threads{},
+        m_pending{0},
+        m_idle{0},
+        m_next{0},
+        m_stop{false} {
+    if (size == 0) size = 1;
+    for (size_t i = 0; i < size; ++i) {
+      m_queues.emplace_back(new Queue{});
+    }
+    for (size_t i = 0; i < size; ++i) {
+      m_threads.emplace_back([this, i] { work(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto &&thread : m_threads) thread.join();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return m_threads.size(); }
+
+  // workers waiting for a task, less the tasks already waiting for them
+  size_t idle() const {
+    const size_t idle = m_idle, pending = m_pending;
+    return idle > pending ? idle - pending : 0;
+  }
+
+  // tasks submitted from a worker stay on its own queue,
+  // others are spread round-robin.
+  void submit(Task task) {
+    size_t index = currentWorker();
+    if (index == NO_WORKER) index = m_next++ % m_queues.size();
+    {
+      auto &queue = *m_queues[index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+      // counted before a worker can take it, so the count never wraps
+      std::lock_guard<std::mutex> pending(m_mutex);
+      ++m_pending;
+    }
+    m_cv.notify_one();
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  static constexpr size_t NO_WORKER = static_cast<size_t>(-1);
+
+  static size_t &currentWorker() {
+    thread_local size_t index = NO_WORKER;
+    return index;
+  }
+
+  bool pop(size_t index, Task &task) {
+    auto &queue = *m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+  }
+
+  bool steal(size_t index, Task &task) {
+    for (size_t i = 1; i < m_queues.size(); ++i) {
+      auto &queue = *m_queues[(index + i) % m_queues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) continue;
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      return true;
+    }
+    return false;
+  }
+
+  void work(size_t index) {
+    currentWorker() = index;
+    Task task;
+    while (true) {
+      if (pop(index, task) || steal(index, task)) {
+        --m_pending;
+        task();
+        task = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(m_mutex);
+      ++m_idle;
+      m_cv.wait(lock, [this] { return m_stop || m_pending > 0; });
+      --m_idle;
+      if (m_stop && m_pending == 0) return;
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::atomic<size_t> m_pending;
+  std::atomic<size_t> m_idle;
+  std::atomic<size_t> m_next;
+  bool m_stop;
+};
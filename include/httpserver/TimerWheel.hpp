@@ -0,0 +1,158 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+const int TIMER_LEVEL_BITS = 6;
+const int TIMER_LEVELS = 4;
+const uint64_t TIMER_SLOTS = uint64_t{1} << TIMER_LEVEL_BITS;  // per level
+using TimerTicks = std::chrono::duration<int64_t, std::centi>;  // 10ms
+
+// hierarchical timing wheel. a timer goes into a slot on the level that
+// matches how far out it expires and moves down a level each time the
+// level below wraps around, so scheduling, cancelling and firing are O(1)
+// however many timers there are. timers never fire early, and late by at
+// most a tick.
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // intrusive list node, embedded in whatever the timer is for.
+  // a timer unschedules itself when destroyed; copies start unscheduled.
+  struct Timer {
+    explicit Timer(uint64_t key = 0)
+        : prev{nullptr}, next{nullptr}, expiry{0}, key{key} {}
+    Timer(const Timer &other) : Timer(other.key) {}
+    Timer &operator=(const Timer &other) {
+      cancel();
+      key = other.key;
+      return *this;
+    }
+    ~Timer() { cancel(); }
+
+    bool scheduled() const { return next != nullptr; }
+
+    void cancel() {
+      if (!next) return;
+      prev->next = next;
+      next->prev = prev;
+      prev = next = nullptr;
+    }
+
+    Timer *prev;
+    Timer *next;
+    uint64_t expiry;  // tick
+    uint64_t key;     // tells the callback whose timer fired
+  };
+
+  TimerWheel() : m_start{Clock::now()}, m_current{0} {
+    for (auto &&level : m_slots) {
+      for (auto &&slot : level) slot.prev = slot.next = &slot;
+    }
+  }
+
+  ~TimerWheel() {
+    for (auto &&level : m_slots) {
+      for (auto &&slot : level) {
+        while (slot.next != &slot) slot.next->cancel();
+        slot.prev = slot.next = nullptr;
+      }
+    }
+  }
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  void schedule(Timer &timer, Clock::time_point when) {
+    timer.cancel();
+    const auto ticks = std::chrono::ceil<TimerTicks>(when - m_start).count();
+    timer.expiry = ticks > 0 && uint64_t(ticks) > m_current ? ticks
+                                                            : m_current + 1;
+    insert(timer);
+  }
+
+  // milliseconds until the next timer may be due, for the poll timeout
+  int timeout(Clock::time_point now) const {
+    const uint64_t wrap = TIMER_SLOTS - (m_current & (TIMER_SLOTS - 1));
+    uint64_t ticks = wrap;
+    for (uint64_t i = 1; i < wrap; ++i) {
+      const auto &slot = m_slots[0][(m_current + i) & (TIMER_SLOTS - 1)];
+      if (slot.next != &slot) {
+        ticks = i;
+        break;
+      }
+    }
+    const auto due = m_start + TimerTicks(m_current + ticks);
+    if (due <= now) return 0;
+    return std::chrono::ceil<std::chrono::milliseconds>(due - now).count();
+  }
+
+  // fires every timer due by now. callback(timer) runs after the timer
+  // has been unscheduled, so it may reschedule or destroy it.
+  template <class Callback>
+  void advance(Clock::time_point now, Callback &&callback) {
+    const uint64_t target =
+        std::chrono::floor<TimerTicks>(now - m_start).count();
+    while (m_current < target) {
+      ++m_current;
+      for (int level = 1; level < TIMER_LEVELS; ++level) {
+        const int shift = level * TIMER_LEVEL_BITS;
+        if (m_current & ((uint64_t{1} << shift) - 1)) break;
+        cascade(m_slots[level][(m_current >> shift) & (TIMER_SLOTS - 1)]);
+      }
+
+      auto &slot = m_slots[0][m_current & (TIMER_SLOTS - 1)];
+      while (slot.next != &slot) {
+        Timer &timer = *slot.next;
+        timer.cancel();
+        if (timer.expiry > m_current) {
+          insert(timer);  // was parked beyond the top level
+          continue;
+        }
+        callback(timer);
+      }
+    }
+  }
+
+ private:
+  void insert(Timer &timer) {
+    const uint64_t delta = timer.expiry - m_current;
+    int level = 0;
+    while (level + 1 < TIMER_LEVELS &&
+           delta >= (uint64_t{1} << ((level + 1) * TIMER_LEVEL_BITS))) {
+      ++level;
+    }
+    // beyond the top level: park in its furthest slot until it is in reach
+    const uint64_t reach = uint64_t{1} << (TIMER_LEVELS * TIMER_LEVEL_BITS);
+    const uint64_t expiry =
+        delta < reach ? timer.expiry : m_current + reach - 1;
+
+    const int shift = level * TIMER_LEVEL_BITS;
+    auto &slot = m_slots[level][(expiry >> shift) & (TIMER_SLOTS - 1)];
+    timer.prev = slot.prev;
+    timer.next = &slot;
+    slot.prev->next = &timer;
+    slot.prev = &timer;
+  }
+
+  // moves the timers of a higher-level slot down to where they belong now
+  void cascade(Timer &slot) {
+    Timer list;
+    if (slot.next == &slot) return;
+    list.next = slot.next;
+    list.prev = slot.prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    slot.prev = slot.next = &slot;
+    while (list.next != &list) {
+      Timer &timer = *list.next;
+      timer.cancel();
+      insert(timer);
+    }
+    list.prev = list.next = nullptr;
+  }
+
+  Clock::time_point m_start;
+  uint64_t m_current;  // last tick processed
+  Timer m_slots[TIMER_LEVELS][TIMER_SLOTS];  // list heads
+};
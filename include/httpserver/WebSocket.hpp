@@ -0,0 +1,254 @@
+#pragma once
+
+#include <HttpRequest.hpp>
+#include <common/StringUtils.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// ------------------------------------
+// Handshake (RFC 6455 section 4)
+// ------------------------------------
+std::string sha1(std::string_view data) {
+  auto rotl = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                   0xC3D2E1F0};
+  auto message = std::string{data};
+  const uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+  message += static_cast<char>(0x80);
+  while (message.size() % 64 != 56) message += '\0';
+  for (int i = 7; i >= 0; --i) message += static_cast<char>(bits >> (i * 8));
+
+  for (size_t block = 0; block < message.size(); block += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      const auto *p =
+          reinterpret_cast<const unsigned char *>(&message[block + i * 4]);
+      w[i] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+    for (int i = 16; i < 80; ++i) {
+      w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      const uint32_t t = rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl(b, 30);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  auto digest = std::string{};
+  for (uint32_t x : h) {
+    for (int i = 3; i >= 0; --i) digest += static_cast<char>(x >> (i * 8));
+  }
+  return digest;
+}
+
+std::string base64(std::string_view data) {
+  static const char a[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  auto ret = std::string{};
+  size_t i = 0;
+  for (; i + 2 < data.size(); i += 3) {
+    const uint32_t n = (uint8_t(data[i]) << 16) | (uint8_t(data[i + 1]) << 8) |
+                       uint8_t(data[i + 2]);
+    ret += a[n >> 18];
+    ret += a[(n >> 12) & 63];
+    ret += a[(n >> 6) & 63];
+    ret += a[n & 63];
+  }
+  if (i + 1 == data.size()) {
+    const uint32_t n = uint8_t(data[i]) << 16;
+    ret += a[n >> 18];
+    ret += a[(n >> 12) & 63];
+    ret += "==";
+  } else if (i + 2 == data.size()) {
+    const uint32_t n = (uint8_t(data[i]) << 16) | (uint8_t(data[i + 1]) << 8);
+    ret += a[n >> 18];
+    ret += a[(n >> 12) & 63];
+    ret += a[(n >> 6) & 63];
+    ret += '=';
+  }
+  return ret;
+}
+
+bool isWebSocketUpgrade(const HttpRequestHeader &header) {
+  return equalsIgnoreCase(valueOf(header, "Upgrade"), "websocket") &&
+         !valueOf(header, "Sec-WebSocket-Key").empty();
+}
+
+std::string webSocketAccept(std::string_view key) {
+  static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  return base64(sha1(std::string{key} + guid));
+}
+
+// ------------------------------------
+// Framing (RFC 6455 section 5)
+// ------------------------------------
+enum class WebSocketOpcode : uint8_t {
+  Continuation = 0x0,
+  Text = 0x1,
+  Binary = 0x2,
+  Close = 0x8,
+  Ping = 0x9,
+  Pong = 0xA,
+};
+
+struct WebSocketFrame {
+  bool fin;
+  WebSocketOpcode opcode;
+  std::string payload;  // unmasked
+};
+
+// decodes one client frame from the front of data.
+// returns the bytes consumed, 0 while the frame is incomplete, or -1 if
+// the frame is malformed or its payload exceeds maxPayload.
+long long parseFrame(std::string_view data, WebSocketFrame &frame,
+                     size_t maxPayload) {
+  if (data.size() < 2) return 0;
+  const auto b0 = uint8_t(data[0]), b1 = uint8_t(data[1]);
+  if (b0 & 0x70) return -1;     // no extensions negotiated
+  if (!(b1 & 0x80)) return -1;  // clients must mask
+  size_t pos = 2;
+  uint64_t length = b1 & 0x7f;
+  if (length >= 126) {
+    const int n = length == 126 ? 2 : 8;
+    if (data.size() < pos + n) return 0;
+    length = 0;
+    for (int i = 0; i < n; ++i) length = (length << 8) | uint8_t(data[pos++]);
+  }
+  if (length > maxPayload) return -1;
+  if (data.size() < pos + 4 + length) return 0;
+  const char *mask = &data[pos];
+  pos += 4;
+
+  frame.fin = b0 & 0x80;
+  frame.opcode = static_cast<WebSocketOpcode>(b0 & 0x0f);
+  frame.payload.resize(length);
+  for (size_t i = 0; i < length; ++i) {
+    frame.payload[i] = data[pos + i] ^ mask[i % 4];
+  }
+  return pos + length;
+}
+
+// encodes an unmasked server frame
+std::string makeFrame(WebSocketOpcode opcode, std::string_view payload) {
+  auto frame = std::string{};
+  frame.reserve(payload.size() + 10);
+  frame += static_cast<char>(0x80 | static_cast<uint8_t>(opcode));
+  if (payload.size() < 126) {
+    frame += static_cast<char>(payload.size());
+  } else if (payload.size() <= 0xffff) {
+    frame += static_cast<char>(126);
+    frame += static_cast<char>(payload.size() >> 8);
+    frame += static_cast<char>(payload.size());
+  } else {
+    frame += static_cast<char>(127);
+    for (int i = 7; i >= 0; --i) {
+      frame += static_cast<char>(uint64_t(payload.size()) >> (i * 8));
+    }
+  }
+  frame += payload;
+  return frame;
+}
+
+// ------------------------------------
+// Connections
+// ------------------------------------
+
+// the sending end of an upgraded connection, safe to use from any thread.
+// frames queue up here until the event loop writes them out.
+class WebSocket {
+ public:
+  explicit WebSocket(std::function<void()> notify)
+      : m_notify{std::move(notify)}, m_frames{}, m_closed{false} {}
+
+  void send(std::string_view text) {
+    enqueue(makeFrame(WebSocketOpcode::Text, text));
+  }
+
+  // queues a close frame; nothing is sent after it, and the loop stops
+  // reading messages and drops the connection once it is written
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_closed) return;
+      m_frames.push_back(makeFrame(WebSocketOpcode::Close, ""));
+      m_closed = true;
+    }
+    m_notify();
+  }
+
+  void enqueue(std::string &&frame) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_closed) return;
+      m_frames.push_back(std::move(frame));
+    }
+    m_notify();
+  }
+
+  bool closed() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_closed;
+  }
+
+  // loop side: next frame to write, false if none is queued
+  bool pop(std::string &frame) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_frames.empty()) return false;
+    frame = std::move(m_frames.front());
+    m_frames.pop_front();
+    return true;
+  }
+
+  // loop side: the connection is gone, drop whatever is sent from now on
+  void detach() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closed = true;
+    m_frames.clear();
+  }
+
+ private:
+  std::function<void()> m_notify;
+  std::mutex m_mutex;
+  std::deque<std::string> m_frames;
+  bool m_closed;
+};
+
+// the application side of one upgraded connection
+struct WebSocketSession {
+  virtual ~WebSocketSession() = default;
+  // called on the event loop, in order, for every complete text or binary
+  // message. it must not block; longer work goes to HttpServer::submit.
+  virtual void onMessage(std::string &&message) = 0;
+};
+
+using WebSocketSessionFactory =
+    std::function<std::shared_ptr<WebSocketSession>(std::shared_ptr<WebSocket>)>;
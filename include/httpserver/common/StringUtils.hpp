@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 inline char toLower(char c) { return 'A' <= c && c <= 'Z' ? c + 'a' - 'A' : c; }
@@ -29,13 +30,12 @@ std::vector<std::string> split(const std::string& s, const std::string& d) {
 }
 
 bool beginsWith(const std::string& str, const std::string& test) {
-  size_t pos = str.find_first_of(test);
-  return pos == 0;
+  return str.compare(0, test.size(), test) == 0;
 }
 
 bool endsWith(const std::string& str, const std::string& test) {
-  size_t pos = str.find_last_of(test);
-  return pos == str.size() - 1;
+  return str.size() >= test.size() &&
+         str.compare(str.size() - test.size(), test.size(), test) == 0;
 }
 
 std::string toLower(const std::string& s) {
@@ -142,6 +142,14 @@ std::string join(const std::vector<std::string> v, const std::string& d) {
   return ret;
 }
 
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (toLower(a[i]) != toLower(b[i])) return false;
+  }
+  return true;
+}
+
 bool contains(const std::string& str, const std::string& pattern) {
   return str.find(pattern) != std::string::npos;
 }
@@ -1,25 +1,70 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
 
 namespace m2h {
 
+// ------------------------------------
+// Character classes
+// ------------------------------------
+// every byte's classes are looked up in a table built at compile time, so
+// a predicate is one load and one test whatever characters it stands for
+enum CharClass : uint8_t {
+  ALPHA = 1 << 0,
+  DIGIT = 1 << 1,
+  SPACE = 1 << 2,     // ' ' '\t'
+  CRLF = 1 << 3,      // '\r' '\n'
+  EMPHASIS = 1 << 4,  // '*' '_'
+  BRACKET = 1 << 5,   // '[' ']' '(' ')'
+  RULE = 1 << 6,      // '-' '*' '_', what a horizontal rule is drawn with
+  TEXT_END = 1 << 7,  // where a run of text ends: '!' '`' brackets,
+                      // emphasis and line breaks
+};
+
+constexpr std::array<uint8_t, 256> makeCharClasses() {
+  auto classes = std::array<uint8_t, 256>{};
+  auto add = [&](const char* chars, uint8_t cls) {
+    for (; *chars; ++chars) classes[uint8_t(*chars)] |= cls;
+  };
+  for (int c = 'a'; c <= 'z'; ++c) classes[c] |= ALPHA;
+  for (int c = 'A'; c <= 'Z'; ++c) classes[c] |= ALPHA;
+  add("0123456789", DIGIT);
+  add(" \t", SPACE);
+  add("\r\n", CRLF | TEXT_END);
+  add("*_", EMPHASIS);
+  add("[]()", BRACKET);
+  add("-*_", RULE);
+  add("!*`[]()_", TEXT_END);
+  return classes;
+}
+
+constexpr std::array<uint8_t, 256> CHAR_CLASSES = makeCharClasses();
+
+constexpr uint8_t classOf(char c) { return CHAR_CLASSES[uint8_t(c)]; }
+constexpr bool hasClass(char c, uint8_t classes) {
+  return classOf(c) & classes;
+}
+
 // ------------------------------------
 // Predicates
 // ------------------------------------
 inline char toLower(char c) { return 'A' <= c && c <= 'Z' ? c + 'a' - 'A' : c; }
 inline char toUpper(char c) { return 'a' <= c && c <= 'z' ? c - 'a' - 'A' : c; }
-inline bool isAlpha(char c) {
-  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
-}
-inline bool isNonZeroDigit(char c) { return '1' <= c && c <= '9'; }
-inline bool isDigit(char c) { return '0' == c || isNonZeroDigit(c); }
+inline bool isAlpha(char c) { return hasClass(c, ALPHA); }
+inline bool isNonZeroDigit(char c) { return c != '0' && hasClass(c, DIGIT); }
+inline bool isDigit(char c) { return hasClass(c, DIGIT); }
 inline bool isCR(char c) { return c == '\r'; }
 inline bool isLF(char c) { return c == '\n'; }
-inline bool isCrlf(char c) { return isCR(c) || isLF(c); }
-inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+inline bool isCrlf(char c) { return hasClass(c, CRLF); }
+inline bool isSpace(char c) { return hasClass(c, SPACE); }
 inline bool isTab(char c) { return c == '\t'; }
-inline bool isLetter(char c) { return isAlpha(c) || isDigit(c) || c == '_'; }
+inline bool isLetter(char c) { return hasClass(c, ALPHA | DIGIT) || c == '_'; }
+inline bool isEmphasis(char c) { return hasClass(c, EMPHASIS); }
+inline bool isBracket(char c) { return hasClass(c, BRACKET); }
+inline bool isRule(char c) { return hasClass(c, RULE); }
+inline bool isTextEnd(char c) { return hasClass(c, TEXT_END); }
 
 bool startWith(const char* p, const std::string& s) {
   const std::size_t len = s.size();
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../TypeAlias.hpp"
+
+namespace m2h {
+
+// text buffer for a document that is edited in place.
+// the text is a sequence of pieces pointing into two buffers: the text the
+// table was assigned and an append-only buffer of everything inserted
+// since, so an edit costs O(pieces) instead of O(document size).
+class PieceTable {
+ public:
+  // the table is rebuilt into a single piece past these limits
+  static constexpr size_t MAX_PIECES = 4096;
+  static constexpr size_t MIN_COMPACT_SIZE = 64 * 1024;
+
+  PieceTable() : original{}, added{}, pieces{}, length{0} {}
+
+  void assign(std::string text) {
+    original = std::move(text);
+    added.clear();
+    pieces.clear();
+    length = original.size();
+    if (length != 0) pieces.push_back(Piece{false, 0, length});
+  }
+
+  size_t size() const { return length; }
+
+  // replaces erase bytes at offset with insert.
+  // returns false, leaving the text unchanged, if the range is out of bounds.
+  bool replace(size_t offset, size_t erase, std::string_view insert) {
+    if (offset > length || erase > length - offset) return false;
+    const size_t first = split(offset);
+    const size_t last = split(offset + erase);
+    pieces.erase(pieces.begin() + first, pieces.begin() + last);
+    length = length - erase + insert.size();
+    if (insert.empty()) return true;
+
+    // typing appends to the piece of the previous keystroke
+    if (first > 0 && pieces[first - 1].added &&
+        pieces[first - 1].start + pieces[first - 1].length == added.size()) {
+      pieces[first - 1].length += insert.size();
+    } else {
+      pieces.insert(pieces.begin() + first,
+                    Piece{true, added.size(), insert.size()});
+    }
+    added.append(insert);
+    if (pieces.size() > MAX_PIECES ||
+        added.size() > std::max(MIN_COMPACT_SIZE, 2 * length)) {
+      compact();
+    }
+    return true;
+  }
+
+  // appends the whole text to out
+  void copyTo(Ref<std::string> out) const {
+    out.reserve(out.size() + length);
+    for (auto&& piece : pieces) {
+      const auto& buffer = piece.added ? added : original;
+      out.append(buffer, piece.start, piece.length);
+    }
+  }
+
+  std::string text() const {
+    auto ret = std::string{};
+    copyTo(ret);
+    return ret;
+  }
+
+ private:
+  struct Piece {
+    bool added;  // which buffer the piece points into
+    size_t start;
+    size_t length;
+  };
+
+  // returns the index of the piece starting at offset, splitting the piece
+  // that contains it if necessary
+  size_t split(size_t offset) {
+    size_t pos = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      if (pos == offset) return i;
+      const auto piece = pieces[i];
+      if (offset < pos + piece.length) {
+        const size_t head = offset - pos;
+        pieces[i].length = head;
+        pieces.insert(pieces.begin() + i + 1,
+                      Piece{piece.added, piece.start + head,
+                            piece.length - head});
+        return i + 1;
+      }
+      pos += piece.length;
+    }
+    return pieces.size();
+  }
+
+  void compact() { assign(text()); }
+
+  std::string original;
+  std::string added;
+  std::vector<Piece> pieces;
+  size_t length;
+};
+
+}  // namespace m2h
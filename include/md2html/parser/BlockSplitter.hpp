@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string_view>
+
+#include "../ParsingUtility.hpp"
+
+namespace m2h {
+
+// finds the blank lines a document can be cut at and each part parsed on
+// its own: blank lines outside ``` fences, after a line that ended with a
+// line break of its own rather than one a horizontal rule took, and before
+// a line that starts neither blank nor indented. the parser is back at the
+// root after such a line, and its last child is an empty line that no
+// block continues, so a fresh parse of the part after it starts from the
+// same state.
+class BlockSplitter {
+ public:
+  explicit BlockSplitter(std::string_view document)
+      : document{document}, line{0}, fenced{false} {}
+
+  // finds the first such blank line at or after from. the part before it
+  // ends at end, without the blank line, and the next one starts at next.
+  // the lines are read once, so from must not go back.
+  bool find(size_t from, size_t &end, size_t &next) {
+    while (line < document.size()) {
+      const size_t eol = document.find('\n', line);
+      if (eol == std::string_view::npos) break;
+      const auto text = document.substr(line, eol - line);
+      const size_t start = line;
+      line = eol + 1;
+      if (text.substr(0, 3) == "```") fenced = !fenced;
+      if (!fenced && start >= from && isBlank(text) &&
+          canEnd(document.substr(0, start)) &&
+          canStart(document.substr(line))) {
+        end = start;
+        next = line;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  static bool isBlank(std::string_view line) {
+    return line.empty() || line == "\r";
+  }
+
+  // a rule takes only the '\r' of "\r\n"
+  static bool canEnd(std::string_view before) {
+    if (before.size() < 2) return false;
+    const char c = before[before.size() - 2];
+    return isCR(c) || (!isRule(c) && !isSpace(c));
+  }
+
+  // an indent would continue a list or code block
+  static bool canStart(std::string_view after) {
+    return !after.empty() && !isSpace(after[0]) && !isCrlf(after[0]);
+  }
+
+  std::string_view document;
+  size_t line;  // start of the next line to read
+  bool fenced;
+};
+
+}  // namespace m2h
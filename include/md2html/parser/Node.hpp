@@ -26,6 +26,9 @@ enum class NodeType {
 
 struct Node {
   explicit Node(NodeType&& type) : type{type}, children{} {}
+  virtual ~Node() {
+    for (auto&& child : children) delete child;
+  }
   virtual void print(std::ostream& ost, const std::string& prefix) = 0;
   virtual NodeType getType() { return type; }
   void addChild(Node* node) { children.push_back(node); }
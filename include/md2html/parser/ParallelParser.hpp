@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../TypeAlias.hpp"
+#include "../tokenizer/Tokenizer.hpp"
+#include "BlockSplitter.hpp"
+#include "Parser.hpp"
+
+namespace m2h {
+
+// the least text worth a thread of its own
+const size_t PARALLEL_CHUNK_SIZE = 128 * 1024;
+
+// tokenizes and parses a large document in chunks on several cores. the
+// chunks are split where BlockSplitter finds the parser starts over
+// anyway, so the nodes are those of parsing the document whole.
+class ParallelParser {
+ public:
+  // hands a task to another thread, such as a pool's worker
+  using Submit = std::function<void(std::function<void()>)>;
+  // how many threads are free to take a task right now
+  using Helpers = std::function<size_t()>;
+
+  // with no submit, each chunk but the first gets a thread of its own.
+  // helpers caps the chunks beyond the caller's own; without it, all
+  // threads but the caller's count as free.
+  explicit ParallelParser(
+      size_t threads = std::thread::hardware_concurrency(),
+      Submit submit = nullptr, Helpers helpers = nullptr)
+      : threads{threads ? threads : 1},
+        submit{std::move(submit)},
+        helpers{std::move(helpers)},
+        chunks{},
+        nodes{} {}
+
+  ParallelParser(const ParallelParser &) = delete;
+  ParallelParser &operator=(const ParallelParser &) = delete;
+
+  // whether a document of size bytes is large enough to be split
+  bool splits(size_t size) const { return chunkCount(size) > 1; }
+
+  // the returned nodes are owned by the parser and live until the next
+  // parse
+  CRef<std::vector<Node *>> parse(std::string_view document) {
+    const size_t free = helpers ? helpers() : threads - 1;
+    auto job = std::make_shared<Job>();
+    job->texts = split(document, std::min(chunkCount(document.size()),
+                                          free + 1));
+    job->parser = this;
+    const size_t count = job->texts.size();
+    while (chunks.size() < count) {
+      chunks.push_back(std::make_unique<Chunk>());
+    }
+
+    auto workers = std::vector<std::thread>{};
+    for (size_t i = 1; i < count; ++i) {
+      if (submit) {
+        submit([job] { job->work(); });
+      } else {
+        workers.emplace_back([job] { job->work(); });
+      }
+    }
+    job->work();
+    job->wait();
+    for (auto &&worker : workers) worker.join();
+
+    // a code span left open reads on into the chunks after it, so from
+    // there on the document is parsed as one
+    size_t used = count;
+    for (size_t i = 0; i + 1 < count; ++i) {
+      if (!chunks[i]->parser.unclosed()) continue;
+      const size_t offset = job->texts[i].data() - document.data();
+      run(i, document.substr(offset), true);
+      used = i + 1;
+      break;
+    }
+
+    nodes.clear();
+    for (size_t i = 0; i < used; ++i) {
+      const auto &children = *chunks[i]->nodes;
+      nodes.insert(nodes.end(), children.begin(), children.end());
+    }
+    return nodes;
+  }
+
+ private:
+  struct Chunk {
+    Tokenizer tokenizer;
+    Parser parser;
+    const std::vector<Node *> *nodes = nullptr;
+  };
+
+  // the chunks of one parse. the caller and the helpers take chunks in
+  // turn until none is left, so the caller never waits on a task that is
+  // still queued, only on chunks being parsed. a helper that starts after
+  // the parse has ended finds none left and touches nothing else.
+  struct Job {
+    void work() {
+      const size_t count = texts.size();
+      for (size_t i = next++; i < count; i = next++) {
+        parser->run(i, texts[i], i + 1 == count);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++finished == count) done.notify_all();
+      }
+    }
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex);
+      done.wait(lock, [this] { return finished == texts.size(); });
+    }
+
+    std::vector<std::string_view> texts;
+    ParallelParser *parser = nullptr;
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t finished = 0;
+  };
+
+  size_t chunkCount(size_t size) const {
+    return std::max<size_t>(1, std::min(threads, size / PARALLEL_CHUNK_SIZE));
+  }
+
+  // a chunk that ends before the document does leaves out its Eof, which
+  // would parse as an empty paragraph
+  void run(size_t i, std::string_view text, bool last) {
+    auto &chunk = *chunks[i];
+    const auto &stream = chunk.tokenizer.tokenize(text);
+    const auto end = last ? stream.tokens.end() : stream.tokens.end() - 1;
+    chunk.nodes = &chunk.parser.parse(stream, end);
+  }
+
+  // splits document into count chunks of about the same size, or fewer.
+  // a chunk ends before a blank line, whose line break tokenizing the
+  // chunk adds back.
+  std::vector<std::string_view> split(std::string_view document,
+                                      size_t count) const {
+    auto texts = std::vector<std::string_view>{};
+    auto splitter = BlockSplitter{document};
+    size_t start = 0, end, next;
+    while (texts.size() + 1 < count) {
+      const size_t left = document.size() - start;
+      const size_t target = start + left / (count - texts.size());
+      if (!splitter.find(target, end, next)) break;
+      texts.push_back(document.substr(start, end - start));
+      start = next;
+    }
+    texts.push_back(document.substr(start));
+    return texts;
+  }
+
+  size_t threads;
+  Submit submit;
+  Helpers helpers;
+  std::vector<std::unique_ptr<Chunk>> chunks;
+  std::vector<Node *> nodes;
+};
+
+}  // namespace m2h
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "../ParsingUtility.hpp"
 #include "../TypeAlias.hpp"
@@ -15,144 +18,166 @@ using token_iterator = std::vector<Token>::const_iterator;
 
 class Parser {
  public:
-  Parser() {}
+  Parser()
+      : root{nullptr},
+        context{},
+        first{},
+        eof{},
+        source{nullptr},
+        backQuotes{},
+        backQuotePairs{},
+        indexed{false},
+        unclosedCode{false} {}
+  ~Parser() { delete root; }
+
+  Parser(const Parser &) = delete;
+  Parser &operator=(const Parser &) = delete;
+
+  // the returned nodes are owned by the parser and live until the next parse.
+  // stops at the next line break once *cancel becomes true, leaving nodes
+  // for only part of the document.
+  CRef<std::vector<Node *>> parse(CRef<TokenStream> stream,
+                                  const std::atomic<bool> *cancel = nullptr) {
+    return parse(stream, stream.tokens.end(), cancel);
+  }
 
-  CRef<std::vector<Node *>> parse(CRef<std::vector<Token>> tokens) {
-    Node *root = new RootNode();
+  // parses the tokens before last, for a part of a document that ends
+  // before its Eof
+  CRef<std::vector<Node *>> parse(CRef<TokenStream> stream,
+                                  token_iterator last,
+                                  const std::atomic<bool> *cancel = nullptr) {
+    const auto &tokens = stream.tokens;
+    source = stream.source;
+    unclosedCode = false;
+    delete root;
+    root = new RootNode();
     context.parent = root;
     context.index = 0;
     context.indent = 0;
 
     token_iterator it = tokens.begin();
-    while (it != tokens.end()) {
-      auto bak = it;
-
-      if (parseIndent(it)) {
-        goto next;
-      } else {
-        it = bak;
-      }
-
-      if (parseBlockQuote(it)) {
-        goto next;
-      } else {
-        it = bak;
-      }
-
-      if (parseOrderedList(it)) {
-        goto next;
-      } else {
-        it = bak;
-      }
-
-      if (parseUnorderedList(root, it)) {
-        goto next;
-      } else {
-        it = bak;
-      }
-
-      if (parseCodeBlock1(it)) {
-        goto next;
-      } else {
-        it = bak;
-      }
-
-      if (parseCodeBlock2(it)) {
-        goto next;
-      } else {
-        it = bak;
-      }
-
-      if (parseInlineCode1(it)) {
-        goto next;
-      } else {
-        it = bak;
-      }
-
-      if (parseInlineCode2(it)) {
-        goto next;
-      } else {
-        it = bak;
+    first = it;
+    eof = tokens.end() - 1;
+    indexed = false;
+    while (it != last) {
+      parseToken(it);
+      if (cancel && it->kind == TokenKind::NewLine &&
+          cancel->load(std::memory_order_relaxed)) {
+        break;
       }
+      ++it;
+    }
+    return root->children;
+  }
 
-      if (parseImage(it)) {
-        goto next;
-      } else {
-        it = bak;
-      }
+  // whether a code span or block was still open at Eof, so the last parse
+  // would have read on into whatever followed its tokens
+  bool unclosed() const { return unclosedCode; }
 
-      if (parseLink(it)) {
-        goto next;
-      } else {
-        it = bak;
+ private:
+  // goes straight to the one rule the token can start, in the order the
+  // rules take precedence: indents, block quotes and list items first,
+  // then code blocks under an indent of four, then the rest. only headings
+  // and the inline rules can fail, falling back to a paragraph.
+  void parseToken(token_iterator &it) {
+    const auto kind = it->kind;
+    if (kind == TokenKind::Indent) {
+      parseIndent(it);
+      return;
+    }
+    if ((kind == TokenKind::Prefix || kind == TokenKind::Text) &&
+        value(it) == "> ") {
+      parseBlockQuote(it);
+      return;
+    }
+    if (kind == TokenKind::Prefix) {
+      const char c = value(it)[0];
+      if (isDigit(c) && context.indent < 4) {
+        parseOrderedList(it);
+        return;
       }
-
-      if (parseEmphasis(it)) {
-        goto next;
-      } else {
-        it = bak;
-      }
-
-      if (parseHeading(it)) {
-        goto next;
-      } else {
-        it = bak;
+      if (c != '#' &&
+          (context.indent < 4 || isAfter(NodeType::UnorderedList))) {
+        parseUnorderedList(it);
+        return;
       }
+    }
+    if (context.indent >= 4) {
+      parseCodeBlock1(it);
+      return;
+    }
 
-      if (parseHorizontal(it)) {
-        goto next;
-      } else {
+    const auto bak = it;
+    switch (kind) {
+      case TokenKind::BackQuote:
+        if (parseCodeBlock2(it)) return;
         it = bak;
-      }
-
-      if (parseNewline(root, it)) {
-        goto next;
-      } else {
+        if (parseInlineCode1(it)) return;
         it = bak;
-      }
-
-      // fallback
-      parseParagraph(it);
-
-    next:
-      ++it;
+        if (parseInlineCode2(it)) return;
+        break;
+      case TokenKind::Exclamation:
+        if (parseImage(it)) return;
+        break;
+      case TokenKind::Bracket:
+        if (parseLink(it)) return;
+        break;
+      case TokenKind::Emphasis:
+        if (parseEmphasis(it)) return;
+        break;
+      case TokenKind::Prefix:
+        if (parseHeading(it)) return;
+        break;
+      case TokenKind::Horizontal:
+        parseHorizontal(it);
+        return;
+      case TokenKind::NewLine:
+        parseNewline(root, it);
+        return;
+      default:
+        break;
     }
-    return root->children;
+    it = bak;
+    parseParagraph(it);
+  }
+
+  bool isAfter(NodeType type) {
+    auto prevSibling = context.prevSibling();
+    return prevSibling && prevSibling->type == type;
   }
 
- private:
   bool parseParagraph(token_iterator &it) {
     auto prevSibling = context.prevSibling();
     if (prevSibling && prevSibling->type == NodeType::Paragraph) {
       auto paragraph = static_cast<ParagraphNode *>(prevSibling);
       if (paragraph->index == context.index) {
-        paragraph->text += "\n" + it->value;
+        paragraph->text += '\n';
+        paragraph->text += value(it);
         return true;
       }
     }
-    context.append(new ParagraphNode(context.index, it->value));
+    context.append(new ParagraphNode(context.index, std::string{value(it)}));
     return true;
   }
 
   bool parseHeading(token_iterator &it) {
     if (it->kind != TokenKind::Prefix) return false;
     int level = 0;
-    for (char c : it->value) {
+    for (char c : value(it)) {
       if (c != '#') break;
       ++level;
     }
     if (level == 0) return false;
     ++it;
     if (it->kind != TokenKind::Text) return false;
-    const std::string value = it->value;
-    context.append(new HeadingNode(level, value));
+    context.append(new HeadingNode(level, std::string{value(it)}));
     return true;
   }
 
   bool parseIndent(token_iterator &it) {
     if (it->kind != TokenKind::Indent) return false;
-    context.index += it->value.size();
-    context.indent += it->value.size();
+    context.index += value(it).size();
+    context.indent += value(it).size();
     return true;
   }
 
@@ -164,12 +189,14 @@ class Parser {
 
   bool parseNewline(Node *root, token_iterator &it) {
     if (it->kind != TokenKind::NewLine) return false;
-    auto prevToken = it - 1;
-    if (prevToken->value == "> ") {
-      context.append(new EmptyLineNode());
-    }
-    if (prevToken->kind == TokenKind::NewLine) {
-      context.append(new EmptyLineNode());
+    if (it != first) {
+      auto prevToken = it - 1;
+      if (value(prevToken) == "> ") {
+        context.append(new EmptyLineNode());
+      }
+      if (prevToken->kind == TokenKind::NewLine) {
+        context.append(new EmptyLineNode());
+      }
     }
     context.parent = root;
     context.index = 0;
@@ -181,17 +208,14 @@ class Parser {
     for (int i = 0; i < 2; ++i, ++it)
       if (it->kind != TokenKind::BackQuote) return false;
 
-    auto code = std::string{};
-    while (it->kind != TokenKind::BackQuote ||
-           (it + 1)->kind != TokenKind::BackQuote) {
-      if ((it + 1)->kind == TokenKind::Eof) return false;
-      code += it->value;
-      ++it;
+    const auto close = nextBackQuotePair(it);
+    if (close == eof) {
+      unclosedCode = true;
+      return false;
     }
-
-    for (int i = 0; i < 2; ++i, ++it)
-      if (it->kind != TokenKind::BackQuote) return false;
-    --it;
+    auto code = std::string{};
+    for (; it != close; ++it) code += value(it);
+    ++it;
 
     auto prevSibling = context.prevSibling();
     if (prevSibling && prevSibling->type == NodeType::Paragraph) {
@@ -203,17 +227,18 @@ class Parser {
   }
 
   bool parseInlineCode2(token_iterator &it) {
-    if (it->value != "`") return false;
+    if (value(it) != "`") return false;
     ++it;
 
-    auto code = std::string{};
-    while (it->kind != TokenKind::BackQuote) {
-      if (it->kind == TokenKind::Eof) return false;
-      code += it->value;
-      ++it;
+    const auto close = nextBackQuote(it);
+    if (close == eof) {
+      unclosedCode = true;
+      return false;
     }
+    auto code = std::string{};
+    for (; it != close; ++it) code += value(it);
 
-    if (it->value != "`") return false;
+    if (value(it) != "`") return false;
 
     auto prevSibling = context.prevSibling();
     if (prevSibling && prevSibling->type == NodeType::Paragraph) {
@@ -231,29 +256,33 @@ class Parser {
     ++it;
 
     if (it->kind != TokenKind::Bracket) return false;
-    if (it->value != "[") return false;
+    if (value(it) != "[") return false;
     ++it;
 
     if (it->kind != TokenKind::Text) return false;
-    auto alt = it->value;
+    auto alt = value(it);
     ++it;
 
     if (it->kind != TokenKind::Bracket) return false;
-    if (it->value != "]") return false;
+    if (value(it) != "]") return false;
     ++it;
 
     if (it->kind != TokenKind::Bracket) return false;
-    if (it->value != "(") return false;
+    if (value(it) != "(") return false;
     ++it;
 
     if (it->kind != TokenKind::Text) return false;
-    auto url = it->value;
+    auto url = value(it);
     ++it;
 
     if (it->kind != TokenKind::Bracket) return false;
-    if (it->value != ")") return false;
+    if (value(it) != ")") return false;
 
-    auto link = "<img src=\"" + url + "\" alt=\"" + alt + "\">";
+    auto link = std::string{"<img src=\""};
+    link += url;
+    link += "\" alt=\"";
+    link += alt;
+    link += "\">";
 
     auto prevSibling = context.prevSibling();
     if (prevSibling && prevSibling->type == NodeType::Paragraph) {
@@ -268,29 +297,33 @@ class Parser {
 
   bool parseLink(token_iterator &it) {
     if (it->kind != TokenKind::Bracket) return false;
-    if (it->value != "[") return false;
+    if (value(it) != "[") return false;
     ++it;
 
     if (it->kind != TokenKind::Text) return false;
-    auto text = it->value;
+    auto text = value(it);
     ++it;
 
     if (it->kind != TokenKind::Bracket) return false;
-    if (it->value != "]") return false;
+    if (value(it) != "]") return false;
     ++it;
 
     if (it->kind != TokenKind::Bracket) return false;
-    if (it->value != "(") return false;
+    if (value(it) != "(") return false;
     ++it;
 
     if (it->kind != TokenKind::Text) return false;
-    auto url = it->value;
+    auto url = value(it);
     ++it;
 
     if (it->kind != TokenKind::Bracket) return false;
-    if (it->value != ")") return false;
+    if (value(it) != ")") return false;
 
-    auto link = "<a href=\"" + url + "\">" + text + "</a>";
+    auto link = std::string{"<a href=\""};
+    link += url;
+    link += "\">";
+    link += text;
+    link += "</a>";
 
     auto prevSibling = context.prevSibling();
     if (prevSibling && prevSibling->type == NodeType::Paragraph) {
@@ -312,10 +345,12 @@ class Parser {
     if (c1 == 0) return false;
 
     if (it->kind != TokenKind::Text) return false;
-    auto text = std::string{};
-    if (c1 == 1) text = "<em>" + it->value + "</em>";
-    if (c1 == 2) text = "<strong>" + it->value + "</strong>";
-    if (c1 >= 3) text = "<em><strong>" + it->value + "</strong></em>";
+    const char *open = c1 == 1 ? "<em>" : c1 == 2 ? "<strong>" : "<em><strong>";
+    const char *close =
+        c1 == 1 ? "</em>" : c1 == 2 ? "</strong>" : "</strong></em>";
+    auto text = std::string{open};
+    text += value(it);
+    text += close;
     ++it;
 
     for (int i = 0; i < c1; ++i, ++it)
@@ -336,7 +371,7 @@ class Parser {
   }
 
   bool parseBlockQuote(token_iterator &it) {
-    if (it->value != "> ") return false;
+    if (value(it) != "> ") return false;
     context.indent = 0;
 
     auto prevSibling = context.prevSibling();
@@ -354,8 +389,8 @@ class Parser {
     if (context.indent < 4) return false;
 
     auto code = std::string{};
-    while (it->kind != TokenKind::NewLine) {
-      code += it->value;
+    while (it->kind != TokenKind::NewLine && it != eof) {
+      code += value(it);
       ++it;
     }
     --it;
@@ -382,14 +417,17 @@ class Parser {
     if (it->kind != TokenKind::NewLine) return false;
     ++it;
 
+    const auto close = nextBackQuote(it);
+    if (close == eof) {
+      unclosedCode = true;
+      return false;
+    }
     auto code = std::string{};
-    while (it->kind != TokenKind::BackQuote) {
-      if (it->kind == TokenKind::Eof) return false;
+    for (; it != close; ++it) {
       if (it->kind == TokenKind::NewLine)
         code += "\n";
       else
-        code += it->value;
-      ++it;
+        code += value(it);
     }
     if (!code.empty()) code.resize(code.size() - 1);
 
@@ -409,7 +447,7 @@ class Parser {
     return true;
   }
 
-  bool parseUnorderedList(Node *root, token_iterator &it) {
+  bool parseUnorderedList(token_iterator &it) {
     auto prevSibling = context.prevSibling();
     const bool isAfterUnorderedList =
         prevSibling && prevSibling->type == NodeType::UnorderedList;
@@ -419,8 +457,8 @@ class Parser {
     }
 
     if (it->kind != TokenKind::Prefix) return false;
-    if (it->value[0] == '#') return false;
-    context.index += it->value.size();
+    if (value(it)[0] == '#') return false;
+    context.index += value(it).size();
     context.indent = 0;
 
     // ul
@@ -434,11 +472,10 @@ class Parser {
       if (currDepth > prevDepth) {
         auto parent = prevlist;
         for (int i = 1; i < currDepth; ++i) {
-          auto nodes = parent->children;
-          std::reverse(nodes.begin(), nodes.end());
-          for (auto node : nodes) {
-            if (node->type == NodeType::UnorderedList) {
-              parent = static_cast<UnorderedListNode *>(node);
+          const auto &nodes = parent->children;
+          for (auto node = nodes.rbegin(); node != nodes.rend(); ++node) {
+            if ((*node)->type == NodeType::UnorderedList) {
+              parent = static_cast<UnorderedListNode *>(*node);
               break;
             }
           }
@@ -472,14 +509,14 @@ class Parser {
     if (context.indent >= 4) return false;
 
     if (it->kind != TokenKind::Prefix) return false;
-    if (!isDigit(it->value[0])) return false;
-    context.index += it->value.size();
+    if (!isDigit(value(it)[0])) return false;
+    context.index += value(it).size();
     context.indent = 0;
     ++it;
 
     while (it->kind == TokenKind::Indent) {
-      context.index += it->value.size();
-      context.indent += it->value.size();
+      context.index += value(it).size();
+      context.indent += value(it).size();
       ++it;
     }
     --it;
@@ -503,7 +540,53 @@ class Parser {
   }
 
  private:
+  std::string_view value(token_iterator it) const {
+    return valueOf(*it, source);
+  }
+
+  // the first BackQuote at or after from, or the Eof if there is none
+  token_iterator nextBackQuote(token_iterator from) {
+    indexBackQuotes();
+    const size_t i = from - first;
+    auto next = std::lower_bound(backQuotes.begin(), backQuotes.end(), i);
+    return next == backQuotes.end() ? eof : first + *next;
+  }
+
+  // the first of two BackQuotes in a row at or after from, or the Eof
+  token_iterator nextBackQuotePair(token_iterator from) {
+    indexBackQuotes();
+    const size_t i = from - first;
+    auto next =
+        std::lower_bound(backQuotePairs.begin(), backQuotePairs.end(), i);
+    return next == backQuotePairs.end() ? eof : first + *next;
+  }
+
+  // a code span left open would otherwise look for its close by reading
+  // on to the Eof, once for each backquote after it
+  void indexBackQuotes() {
+    if (indexed) return;
+    indexed = true;
+    backQuotes.clear();
+    backQuotePairs.clear();
+    for (auto it = first; it != eof; ++it) {
+      if (it->kind != TokenKind::BackQuote) continue;
+      const size_t i = it - first;
+      if (!backQuotes.empty() && backQuotes.back() + 1 == i) {
+        backQuotePairs.push_back(i - 1);
+      }
+      backQuotes.push_back(i);
+    }
+  }
+
+  Node *root;
   ParsingContext context;
+  token_iterator first;  // start of the tokens being parsed
+  token_iterator eof;
+  const char *source;    // the text the tokens point into
+  std::vector<size_t> backQuotes;      // indices of the BackQuotes
+  std::vector<size_t> backQuotePairs;  // and of those a BackQuote follows
+  bool indexed;                        // whether the two are filled in
+  bool unclosedCode;
 };
 
 }  // namespace m2h
@@ -10,7 +10,7 @@ struct ParsingContext {
   int indent;
 
   Node *prevSibling() {
-    auto children = parent->children;
+    const auto &children = parent->children;
     return children.empty() ? nullptr : children.back();
   }
 
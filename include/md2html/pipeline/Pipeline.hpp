@@ -0,0 +1,181 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../parser/BlockSplitter.hpp"
+#include "../parser/Parser.hpp"
+#include "../tokenizer/Tokenizer.hpp"
+#include "SpscQueue.hpp"
+
+namespace m2h {
+
+// the least text a block holds, unless the document ends first
+const size_t PIPELINE_BLOCK_SIZE = 16 * 1024;
+// blocks waiting between two stages
+const size_t PIPELINE_DEPTH = 4;
+// the least text worth starting the stages for
+const size_t PIPELINE_MIN_SIZE = 4 * PIPELINE_BLOCK_SIZE;
+
+// renders a document in three stages running at once: a thread tokenizes
+// it a block at a time, another parses the blocks, and the caller prints
+// their nodes as each block is parsed. blocks are cut where BlockSplitter
+// finds the parser starts over, so a parsed block's nodes are final.
+// blocks go back to the tokenizer once printed, so no more of them are in
+// memory than fit in the queues, whatever the size of the document.
+// the two stage threads live as long as the pipeline and sleep between
+// documents.
+class Pipeline {
+ public:
+  Pipeline()
+      : blocks{},
+        tokenized{PIPELINE_DEPTH},
+        parsed{PIPELINE_DEPTH},
+        unused{POOL_SIZE},
+        current{},
+        generation{0},
+        stopped{false} {
+    for (size_t i = 0; i < POOL_SIZE; ++i) {
+      blocks.push_back(std::make_unique<Block>());
+      unused.push(blocks.back().get());
+    }
+    tokenizing = std::thread([this] { serve(&Pipeline::tokenize); });
+    parsing = std::thread([this] { serve(&Pipeline::parse); });
+  }
+
+  ~Pipeline() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopped = true;
+    }
+    started.notify_all();
+    tokenizing.join();
+    parsing.join();
+  }
+
+  Pipeline(const Pipeline &) = delete;
+  Pipeline &operator=(const Pipeline &) = delete;
+
+  // every block is back in unused by the time this returns, and the stage
+  // threads are done with the document
+  void render(std::string_view document, std::ostream &out) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      current = document;
+      ++generation;
+    }
+    started.notify_all();
+    print(out);
+  }
+
+ private:
+  struct Block {
+    Tokenizer tokenizer;
+    Parser parser;
+    size_t start = 0;  // of its text in the document
+    bool last = false;
+    // null for a block taken into the one before it
+    const std::vector<Node *> *nodes = nullptr;
+  };
+
+  // one block in each stage besides those in the queues
+  static constexpr size_t POOL_SIZE = 2 * PIPELINE_DEPTH + 3;
+
+  // runs stage on each document render hands over, until stopped
+  void serve(void (Pipeline::*stage)(std::string_view)) {
+    uint64_t done = 0;
+    while (true) {
+      std::string_view next;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        started.wait(lock, [&] { return stopped || generation != done; });
+        if (stopped) return;
+        done = generation;
+        next = current;
+      }
+      (this->*stage)(next);
+    }
+  }
+
+  void tokenize(std::string_view document) {
+    auto splitter = BlockSplitter{document};
+    size_t start = 0;
+    bool last = false;
+    while (!last) {
+      auto block = unused.pop();
+      size_t end = 0, next = 0;
+      last = !splitter.find(start + PIPELINE_BLOCK_SIZE, end, next);
+      if (last) end = document.size();
+      block->start = start;
+      block->last = last;
+      block->tokenizer.tokenize(document.substr(start, end - start));
+      tokenized.push(block);
+      start = next;
+    }
+  }
+
+  void parse(std::string_view document) {
+    while (true) {
+      auto block = tokenized.pop();
+      run(*block);
+      if (block->parser.unclosed() && !block->last) {
+        // a code span left open reads on into the blocks after it, so the
+        // rest of the document is parsed as one
+        while (!block->last) {
+          auto after = tokenized.pop();
+          block->last = after->last;
+          after->last = false;
+          after->nodes = nullptr;
+          parsed.push(after);
+        }
+        block->tokenizer.tokenize(document.substr(block->start));
+        run(*block);
+      }
+      const bool last = block->last;
+      parsed.push(block);
+      if (last) return;
+    }
+  }
+
+  void print(std::ostream &out) {
+    while (true) {
+      auto block = parsed.pop();
+      const bool last = block->last;
+      if (block->nodes) {
+        for (auto &&node : *block->nodes) node->print(out, "");
+      }
+      unused.push(block);
+      if (last) return;
+    }
+  }
+
+  // a block that ends before the document does leaves out its Eof, which
+  // would parse as an empty paragraph
+  void run(Block &block) {
+    const auto &stream = block.tokenizer.tokens();
+    const auto end =
+        block.last ? stream.tokens.end() : stream.tokens.end() - 1;
+    block.nodes = &block.parser.parse(stream, end);
+  }
+
+  std::vector<std::unique_ptr<Block>> blocks;
+  SpscQueue<Block *> tokenized;  // from the tokenizer to the parser
+  SpscQueue<Block *> parsed;     // from the parser to the caller
+  SpscQueue<Block *> unused;     // from the caller back to the tokenizer
+
+  std::thread tokenizing;
+  std::thread parsing;
+  std::mutex mutex;
+  std::condition_variable started;
+  std::string_view current;   // the document being rendered
+  uint64_t generation;        // documents handed to the stages so far
+  bool stopped;
+};
+
+}  // namespace m2h
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace m2h {
+
+// tries at a full or empty queue before going to sleep on it
+const int SPSC_SPINS = 64;
+
+// bounded ring buffer between one producer thread and one consumer thread.
+// each side only writes its own index, so neither takes a lock while the
+// queue has room and items. a side that finds it full or empty yields for
+// a few tries, then sleeps until the other side wakes it.
+template <class T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : slots(capacity + 1),
+        head{0},
+        tail{0},
+        pushWaiting{false},
+        popWaiting{false} {}
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  // moves value in unless the queue is full
+  bool tryPush(T &value) {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    const size_t next = t + 1 == slots.size() ? 0 : t + 1;
+    if (next == head.load(std::memory_order_acquire)) return false;
+    slots[t] = std::move(value);
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T &value) {
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+    value = std::move(slots[h]);
+    head.store(h + 1 == slots.size() ? 0 : h + 1, std::memory_order_release);
+    return true;
+  }
+
+  void push(T value) {
+    if (!tryPush(value)) {
+      wait(notFull, pushWaiting, [&] { return tryPush(value); });
+    }
+    wake(notEmpty, popWaiting);
+  }
+
+  T pop() {
+    T value;
+    if (!tryPop(value)) {
+      wait(notEmpty, popWaiting, [&] { return tryPop(value); });
+    }
+    wake(notFull, pushWaiting);
+    return value;
+  }
+
+ private:
+  template <class Ready>
+  void wait(std::condition_variable &cv, std::atomic<bool> &waiting,
+            Ready ready) {
+    for (int i = 0; i < SPSC_SPINS; ++i) {
+      std::this_thread::yield();
+      if (ready()) return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    waiting = true;
+    // the other side either sees waiting or made the queue ready before
+    // it looked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv.wait(lock, ready);
+    waiting = false;
+  }
+
+  void wake(std::condition_variable &cv, std::atomic<bool> &waiting) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!waiting.load(std::memory_order_relaxed)) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    cv.notify_one();
+  }
+
+  std::vector<T> slots;  // one more than the capacity, to tell full from
+                         // empty
+  alignas(64) std::atomic<size_t> head;  // next to pop
+  alignas(64) std::atomic<size_t> tail;  // next to push
+  // only taken to sleep and to wake a sleeper
+  std::mutex mutex;
+  std::condition_variable notFull;
+  std::condition_variable notEmpty;
+  std::atomic<bool> pushWaiting;
+  std::atomic<bool> popWaiting;
+};
+
+}  // namespace m2h
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../ParsingUtility.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define M2H_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace m2h {
+
+// finders for the next character a text run ends at: one of "!*`[]()_"
+// or a line break. they return last if there is none before it, and read
+// nothing at or past last.
+using TextScanner = const char* (*)(const char* p, const char* last);
+
+inline const char* scanTextScalar(const char* p, const char* last) {
+  while (p < last && !isTextEnd(*p)) ++p;
+  return p;
+}
+
+#ifdef M2H_SCAN_X86
+
+__attribute__((target("sse2"))) inline const char* scanTextSse2(
+    const char* p, const char* last) {
+  const __m128i specials[] = {
+      _mm_set1_epi8('!'), _mm_set1_epi8('*'),  _mm_set1_epi8('`'),
+      _mm_set1_epi8('['), _mm_set1_epi8(']'),  _mm_set1_epi8('('),
+      _mm_set1_epi8(')'), _mm_set1_epi8('_'),  _mm_set1_epi8('\r'),
+      _mm_set1_epi8('\n')};
+  for (; last - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i hits = _mm_setzero_si128();
+    for (auto&& special : specials) {
+      hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, special));
+    }
+    const int mask = _mm_movemask_epi8(hits);
+    if (mask) return p + __builtin_ctz(mask);
+  }
+  return scanTextScalar(p, last);
+}
+
+// classifies all 32 bytes at once by their nibbles: each special's high
+// nibble has a bit, and the table for the low nibble holds the bits of the
+// high nibbles it is special with
+__attribute__((target("avx2"))) inline const char* scanTextAvx2(
+    const char* p, const char* last) {
+  // high nibbles 0 (\n \r), 2 (! ( ) *), 5 ([ ] _) and 6 (`)
+  const __m256i low = _mm256_setr_epi8(
+      8, 2, 0, 0, 0, 0, 0, 0, 2, 2, 3, 4, 0, 5, 0, 4,  //
+      8, 2, 0, 0, 0, 0, 0, 0, 2, 2, 3, 4, 0, 5, 0, 4);
+  const __m256i high = _mm256_setr_epi8(
+      1, 0, 2, 0, 0, 4, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0,  //
+      1, 0, 2, 0, 0, 4, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  for (; last - p >= 32; p += 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i l = _mm256_shuffle_epi8(low, _mm256_and_si256(v, nibble));
+    const __m256i h = _mm256_shuffle_epi8(
+        high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    const __m256i misses =
+        _mm256_cmpeq_epi8(_mm256_and_si256(l, h), _mm256_setzero_si256());
+    const unsigned mask = ~_mm256_movemask_epi8(misses);
+    if (mask) return p + __builtin_ctz(mask);
+  }
+  return scanTextSse2(p, last);
+}
+
+#endif
+
+// the fastest finder this CPU runs, picked on first use
+inline TextScanner textScanner() {
+#ifdef M2H_SCAN_X86
+  static const TextScanner scanner = []() -> TextScanner {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return scanTextAvx2;
+    if (__builtin_cpu_supports("sse2")) return scanTextSse2;
+    return scanTextScalar;
+  }();
+  return scanner;
+#else
+  return scanTextScalar;
+#endif
+}
+
+inline const char* scanText(const char* p, const char* last) {
+  return textScanner()(p, last);
+}
+
+}  // namespace m2h
@@ -1,10 +1,12 @@
 #pragma once
 
-#include <string>
+#include <cstdint>
+#include <string_view>
+#include <vector>
 
 namespace m2h {
 
-enum class TokenKind {
+enum class TokenKind : uint8_t {
   Prefix,  // reserved characters '! + - * # <digit>*.'
   Indent,
   Emphasis,  // * _
@@ -17,12 +19,62 @@ enum class TokenKind {
   Eof
 };
 
+// a token is the span of source it was read from, nothing is copied
 struct Token {
-  explicit Token(TokenKind kind, const std::string& value, const char* location)
-      : kind{kind}, value{value}, location{location} {}
   TokenKind kind;
-  std::string value;
-  const char* location;
+  uint32_t offset;  // from the start of the source
+  uint32_t length;
 };
 
+static_assert(sizeof(Token) == 12, "tokens are packed");
+
+// a line of the source and where its tokens start. its tokens end where
+// those of the next line start, the tokens of the last one at Eof.
+struct Line {
+  uint32_t offset;
+  uint32_t token;
+};
+
+// the tokens of a document, the text they point into and its lines
+struct TokenStream {
+  const char* source = nullptr;
+  std::vector<Token> tokens;
+  std::vector<Line> lines;
+};
+
+inline int indentWidth(char c) { return c == '\t' ? 4 : 1; }
+
+// what the token stands for. mostly its source, but an indent is as many
+// spaces as it is wide, list and heading prefixes end with a space whatever
+// separated them from the text, and line breaks have no text.
+inline std::string_view valueOf(const Token& token, const char* source) {
+  static const char spaces[] = "        ";
+  static const char hashes[] =
+      "################################################################"
+      "############################################################### ";
+  const auto text = std::string_view{source + token.offset, token.length};
+  switch (token.kind) {
+    case TokenKind::Indent: {
+      size_t width = 0;
+      for (char c : text) width += indentWidth(c);
+      return {spaces, width};
+    }
+    case TokenKind::NewLine:
+    case TokenKind::Eof:
+      return {};
+    case TokenKind::Prefix:
+      if (text[0] == '>') return "> ";
+      if (text.back() == ' ' || text.back() == '.') return text;
+      if (text[0] == '#' && text.size() < sizeof(hashes)) {
+        return {hashes + sizeof(hashes) - 1 - text.size(), text.size()};
+      }
+      if (text[0] == '*') return "* ";
+      if (text[0] == '+') return "+ ";
+      if (text[0] == '-') return "- ";
+      return text;
+    default:
+      return text;
+  }
+}
+
 }  // namespace m2h
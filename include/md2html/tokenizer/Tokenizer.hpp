@@ -1,258 +1,482 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "../ParsingUtility.hpp"
 #include "../TypeAlias.hpp"
+#include "TextScanner.hpp"
 #include "Token.hpp"
 
 namespace m2h {
 
+// what a run may be, by its first byte
+enum class Lead : uint8_t {
+  Text,
+  Indent,
+  NewLine,
+  BackQuote,
+  Bracket,
+  OrderedList,
+  Rule,  // a horizontal rule or, unless it is '_', a list item
+  UnorderedList,
+  BlockQuote,
+  Heading
+};
+
+constexpr std::array<Lead, 256> makeLeads() {
+  auto leads = std::array<Lead, 256>{};
+  auto add = [&](const char* chars, Lead lead) {
+    for (; *chars; ++chars) leads[uint8_t(*chars)] = lead;
+  };
+  add(" \t", Lead::Indent);
+  add("\r\n", Lead::NewLine);
+  add("`", Lead::BackQuote);
+  add("[]()", Lead::Bracket);
+  add("0123456789", Lead::OrderedList);
+  add("-*_", Lead::Rule);
+  add("+", Lead::UnorderedList);
+  add(">", Lead::BlockQuote);
+  add("#", Lead::Heading);
+  return leads;
+}
+
+constexpr std::array<Lead, 256> LEADS = makeLeads();
+
+// lines [first, last) of a document
+struct LineRange {
+  size_t first;
+  size_t last;
+};
+
 struct TokenizerContext {
-  const char* savepoint = nullptr;
+  // where a prefix that turned out to be text stopped reading. nothing
+  // before it ends a text run, so the text scan resumes there.
+  const char* plain = nullptr;
 };
 
+// tokenizes a document pushed to it in chunks of any size, such as the
+// reads of a socket or a file into a fixed buffer. the text is kept in a
+// buffer of the tokenizer's own, which the tokens point into; chunks need
+// not outlive feed() nor end with a NUL.
 class Tokenizer {
  public:
-  explicit Tokenizer() : tokens{}, context{} {}
-
-  CRef<std::vector<Token>> tokenize(const char* p) {
-    while (*p != '\0') {
-      if (isSpace(*p)) {
-        // Indent
-        bool ok = tokenizeIndent(p);
-        if (!ok) {
-          p = context.savepoint;
-          goto fallback;
-        }
-        continue;
-      }
+  explicit Tokenizer()
+      : text{},
+        stream{},
+        spareTokens{},
+        spareLines{},
+        context{},
+        tokenized{0},
+        limit{nullptr},
+        cancel{nullptr},
+        scan{textScanner()} {}
 
-      if (isCrlf(*p)) {
-        // NewLine
-        tokenizeNewLine(p);
-        continue;
-      }
+  // stops at the next line break once *cancel becomes true, leaving
+  // tokens for only part of the document
+  CRef<TokenStream> tokenize(std::string_view document,
+                             const std::atomic<bool>* cancel = nullptr) {
+    reset(cancel);
+    feed(document);
+    return finish();
+  }
 
-      if (*p == '`') {
-        // BackQuotes
-        context.savepoint = p;
-        bool ok = tokenizeBackQuote(p);
-        if (!ok) {
-          p = context.savepoint;
-          goto fallback;
-        }
-        continue;
-      }
+  // starts over with an empty document. the buffers keep their capacity
+  // for the next one.
+  void reset(const std::atomic<bool>* cancel = nullptr) {
+    text.clear();
+    stream.source = nullptr;
+    stream.tokens.clear();
+    stream.lines.clear();
+    context = TokenizerContext{};
+    tokenized = 0;
+    this->cancel = cancel;
+  }
 
-      if (oneof(*p, "[]()")) {
-        // brackets
-        context.savepoint = p;
-        bool ok = tokenizeBracket(p);
-        if (!ok) {
-          p = context.savepoint;
-          goto fallback;
-        }
-        continue;
-      }
+  // for a document of a known size, saves growing the buffer as it arrives
+  void reserve(size_t size) { text.reserve(size + 1); }
 
-      if (isDigit(*p)) {
-        // OrderedListItems
-        context.savepoint = p;
-        bool ok = tokenizeOrderedList(p);
-        if (!ok) {
-          p = context.savepoint;
-          goto fallback;
-        }
-        continue;
-      }
+  // tokenizes the lines chunk completes. the rest of it, such as the "1"
+  // of "1. " or a '\r' that a '\n' may follow, waits for the next chunk.
+  void feed(std::string_view chunk) {
+    text.append(chunk);
+    auto eol = text.find_last_of("\r\n");
+    if (eol != std::string::npos && eol + 1 == text.size() &&
+        text[eol] == '\r') {
+      eol = eol ? text.find_last_of("\r\n", eol - 1) : std::string::npos;
+    }
+    if (eol == std::string::npos || eol < tokenized) return;
+    append(eol + 1);
+  }
 
-      if (oneof(*p, "+-*_")) {
-        // Horizontal
-        context.savepoint = p;
-        bool ok = tokenizeHorizontal(p);
-        if (ok) continue;
-        p = context.savepoint;
-
-        // UnorderedListItems
-        ok = tokenizeUnorderedList(p);
-        if (!ok) {
-          p = context.savepoint;
-          goto fallback;
-        }
-        continue;
-      }
+  // ends the document with a line break, tokenizes what is left of it
+  // and returns the tokens, which are good until the next reset()
+  CRef<TokenStream> finish() {
+    text += '\n';
+    append(text.size());
+    emit(TokenKind::Eof, tokenized, tokenized);
+    return stream;
+  }
 
-      if (*p == '>') {
-        // BlockQuote
-        context.savepoint = p;
-        bool ok = tokenizeBlockQuote(p);
-        if (!ok) {
-          p = context.savepoint;
-          goto fallback;
-        }
-        continue;
-      }
+  CRef<TokenStream> tokens() const { return stream; }
+
+  // replaces erase bytes at offset of a finished document with insert and
+  // tokenizes the lines that changed again, keeping the tokens of the
+  // rest. returns the lines whose tokens may parse differently now: the
+  // lines re-tokenized and, if backquotes changed, the fenced code blocks
+  // around them, or every line after them if a fence came or went.
+  LineRange edit(size_t offset, size_t erase, std::string_view insert) {
+    auto& tokens = stream.tokens;
+    auto& lines = stream.lines;
+    if (tokenized != text.size()) {
+      // the last tokenize was cancelled, there is nothing to keep
+      text.replace(offset, erase, insert);
+      text.pop_back();
+      const auto document = std::move(text);
+      tokenize(document);
+      return {0, lines.size()};
+    }
+
+    // the line before is tokenized again as well if a '\n' may now
+    // follow its '\r'
+    size_t first = lineAt(offset);
+    if (first > 0 && lines[first].offset == offset &&
+        text[offset - 1] == '\r') {
+      --first;
+    }
+    const size_t last = lineAt(offset + erase) + 1;
+    const size_t start = lines[first].offset;
+    const size_t end = last < lines.size() ? lines[last].offset : text.size();
+    const bool backQuotes =
+        std::string_view{text}.substr(start, end - start).find('`') !=
+        std::string_view::npos;
+    const int fences = countFences(first, last);
 
-      if (*p == '#') {
-        // Heading
-        context.savepoint = p;
-        bool ok = tokenizeHeading(p);
-        if (!ok) {
-          p = context.savepoint;
-          goto fallback;
-        }
-        continue;
+    // set aside the lines after the edit, and drop the ones it touches
+    tokens.pop_back();  // Eof
+    const size_t tokenEnd =
+        last < lines.size() ? lines[last].token : tokens.size();
+    spareLines.assign(lines.begin() + last, lines.end());
+    spareTokens.assign(tokens.begin() + tokenEnd, tokens.end());
+    tokens.resize(lines[first].token);
+    lines.resize(first);
+    text.replace(offset, erase, insert);
+    const long delta = long(insert.size()) - long(erase);
+    auto moved = [&](const Line& line) { return size_t(line.offset + delta); };
+
+    // tokenizes lines from the first one touched until one starts where a
+    // line set aside did. the text from there on is as it was, and so are
+    // its tokens.
+    stream.source = text.data();
+    limit = text.data() + text.size();
+    const char* p = text.data() + start;
+    size_t next = 0;
+    while (p < limit) {
+      const size_t at = p - text.data();
+      if (at >= offset + insert.size()) {
+        while (next < spareLines.size() && moved(spareLines[next]) < at) ++next;
+        if (next < spareLines.size() && moved(spareLines[next]) == at) break;
+      }
+      beginLine(p);
+      p = tokenizeLine(p);
+    }
+    auto dirty = LineRange{first, lines.size()};
+    if (p < limit) {
+      const uint32_t from = spareLines[next].token;
+      const long shift = long(tokens.size()) - long(from);
+      const size_t lineFrom = lines.size();
+      const size_t tokenFrom = tokens.size();
+      lines.insert(lines.end(), spareLines.begin() + next, spareLines.end());
+      tokens.insert(tokens.end(), spareTokens.begin() + (from - tokenEnd),
+                    spareTokens.end());
+      for (size_t i = lineFrom; i < lines.size(); ++i) {
+        lines[i].offset = uint32_t(lines[i].offset + delta);
+        lines[i].token = uint32_t(lines[i].token + shift);
+      }
+      for (size_t i = tokenFrom; i < tokens.size(); ++i) {
+        tokens[i].offset = uint32_t(tokens[i].offset + delta);
       }
+    }
+    tokenized = text.size();
+    emit(TokenKind::Eof, tokenized, tokenized);
 
-    fallback:
-      tokenizeText(p);
+    if (!backQuotes && !hasBackQuote(dirty)) return dirty;
+    if (countFences(dirty.first, dirty.last) != fences) {
+      return {enclosingFence(dirty.first).first, lines.size()};
     }
-    tokens.emplace_back(TokenKind::Eof, "", p);
-    return tokens;
+    return {enclosingFence(dirty.first).first,
+            enclosingFence(dirty.last - 1).last};
   }
 
  private:
-  bool tokenizeIndent(const char*& p) {
+  size_t lineAt(size_t offset) const {
+    const auto& lines = stream.lines;
+    auto it = std::upper_bound(
+        lines.begin(), lines.end(), offset,
+        [](size_t offset, const Line& line) { return offset < line.offset; });
+    return it == lines.begin() ? 0 : it - lines.begin() - 1;
+  }
+
+  size_t lineEnd(size_t line) const {
+    const auto& lines = stream.lines;
+    return line + 1 < lines.size() ? lines[line + 1].token
+                                   : stream.tokens.size() - 1;
+  }
+
+  // a line starting with ``` opens or closes a fenced code block
+  bool isFence(size_t line) const {
+    const size_t first = stream.lines[line].token;
+    if (lineEnd(line) < first + 3) return false;
+    for (size_t i = first; i < first + 3; ++i) {
+      if (stream.tokens[i].kind != TokenKind::BackQuote) return false;
+    }
+    return true;
+  }
+
+  int countFences(size_t first, size_t last) const {
     int count = 0;
-    const char* loc = p;
-    while (isSpace(*p)) {
-      if (*p == '\t') {
-        count += 4;
-      } else {
-        count += 1;
+    for (size_t line = first; line < last; ++line) count += isFence(line);
+    return count;
+  }
+
+  bool hasBackQuote(LineRange range) const {
+    if (range.first == range.last) return false;
+    const auto& tokens = stream.tokens;
+    return std::any_of(
+        tokens.begin() + stream.lines[range.first].token,
+        tokens.begin() + lineEnd(range.last - 1),
+        [](const Token& token) { return token.kind == TokenKind::BackQuote; });
+  }
+
+  // the lines of the fenced code block line is in, fences included, or
+  // just line if it is in none
+  LineRange enclosingFence(size_t line) const {
+    size_t open = 0;
+    bool inside = false;
+    for (size_t i = 0; i < stream.lines.size(); ++i) {
+      if (!isFence(i)) continue;
+      if (!inside) {
+        if (i > line) break;
+        open = i;
+      } else if (i >= line) {
+        return {open, i + 1};
       }
-      ++p;
+      inside = !inside;
+    }
+    if (inside) return {open, stream.lines.size()};
+    return {line, line + 1};
+  }
+
+  // appends the tokens of the text from where the last call stopped to
+  // last, which must follow a line break
+  void append(size_t last) {
+    stream.source = text.data();
+    const char* p = text.data() + tokenized;
+    limit = text.data() + last;
+    while (p < limit) {
+      if (cancelled()) return;
+      beginLine(p);
+      p = tokenizeLine(p);
+      tokenized = p - text.data();
+    }
+  }
+
+  void beginLine(const char* p) {
+    stream.lines.push_back(Line{static_cast<uint32_t>(p - stream.source),
+                                static_cast<uint32_t>(stream.tokens.size())});
+  }
+
+  // tokenizes from the start of a line to the start of the next
+  const char* tokenizeLine(const char* p) {
+    while (p < limit) {
+      // the tokenizers below only move p when they succeed, so on failure
+      // the run is text from where it started
+      switch (LEADS[uint8_t(*p)]) {
+        case Lead::Text:
+          break;
+        case Lead::Indent:
+          if (tokenizeIndent(p)) continue;
+          break;
+        case Lead::NewLine:
+          if (tokenizeNewLine(p)) return p;
+          break;
+        case Lead::BackQuote:
+          if (tokenizeBackQuote(p)) continue;
+          break;
+        case Lead::Bracket:
+          if (tokenizeBracket(p)) continue;
+          break;
+        case Lead::OrderedList:
+          if (tokenizeOrderedList(p)) continue;
+          break;
+        case Lead::Rule:
+          if (tokenizeHorizontal(p)) return p;
+          if (tokenizeUnorderedList(p)) continue;
+          break;
+        case Lead::UnorderedList:
+          if (tokenizeUnorderedList(p)) continue;
+          break;
+        case Lead::BlockQuote:
+          if (tokenizeBlockQuote(p)) continue;
+          break;
+        case Lead::Heading:
+          if (tokenizeHeading(p)) continue;
+          break;
+      }
+      tokenizeText(p);
+    }
+    return p;
+  }
+  bool tokenizeIndent(const char*& p) {
+    int count = 0;
+    const char* q = p;
+    while (isSpace(*q)) {
+      count += indentWidth(*q);
+      ++q;
       if (count >= 4) break;
     }
     if (count == 0) return false;
-    tokens.emplace_back(TokenKind::Indent, std::string(count, ' '), loc);
+    emit(TokenKind::Indent, p, q);
+    p = q;
     return true;
   }
 
   bool tokenizeHeading(const char*& p) {
-    const char* loc = p;
-    int count = 0;
-    while (*p == '#') {
-      ++count;
-      ++p;
+    const char* q = p;
+    while (*q == '#') ++q;
+    if (!isSpace(*q)) {
+      context.plain = q;
+      return false;
     }
-    if (!isSpace(*p)) return false;
-    ++p;
-    tokens.emplace_back(TokenKind::Prefix, std::string(count, '#') + " ", loc);
+    ++q;
+    emit(TokenKind::Prefix, p, q);
+    p = q;
     return true;
   }
 
   bool tokenizeHorizontal(const char*& p) {
-    const char* loc = p;
+    const char* q = p;
     int count = 0;
-    while (oneof(*p, "-*_") || isSpace(*p)) {
-      if (!isSpace(*p)) ++count;
-      ++p;
+    while (hasClass(*q, RULE | SPACE)) {
+      if (isRule(*q)) ++count;
+      ++q;
     }
 
     if (count < 3) return false;
-    if (!isCrlf(*p)) return false;
-    ++p;
+    if (!isCrlf(*q)) return false;
+    ++q;
 
-    tokens.emplace_back(TokenKind::Horizontal, std::string{loc, p}, loc);
+    emit(TokenKind::Horizontal, p, q);
+    p = q;
     return true;
   }
 
   bool tokenizeBackQuote(const char*& p) {
-    const char* loc = p;
     if (*p != '`') return false;
+    emit(TokenKind::BackQuote, p, p + 1);
     ++p;
-    tokens.emplace_back(TokenKind::BackQuote, "`", loc);
     return true;
   }
 
   bool tokenizeBlockQuote(const char*& p) {
-    const char* loc = p;
-    if (*p != '>') return false;
-    ++p;
-    if (isSpace(*p)) ++p;
-    tokens.emplace_back(TokenKind::Prefix, "> ", loc);
+    const char* q = p;
+    if (*q != '>') return false;
+    ++q;
+    if (isSpace(*q)) ++q;
+    emit(TokenKind::Prefix, p, q);
+    p = q;
     return true;
   }
 
   bool tokenizeBracket(const char*& p) {
-    const char* loc = p;
-    if (!oneof(*p, "[]()")) return false;
-    tokens.emplace_back(TokenKind::Bracket, std::string{*p}, loc);
+    if (!isBracket(*p)) return false;
+    emit(TokenKind::Bracket, p, p + 1);
     ++p;
     return true;
   }
 
   bool tokenizeText(const char*& p) {
     const char* p1 = p;
-    while (!isCrlf(*p)) {
-      while (!oneof(*p, "!*`[]()_") && !isCrlf(*p)) ++p;
-      auto text = std::string{p1, p};
-      if (!text.empty()) {
-        tokens.emplace_back(TokenKind::Text, text, p1);
+    if (context.plain) {
+      p = context.plain;
+      context.plain = nullptr;
+    }
+    while (true) {
+      p = scan(p, limit);
+      if (p != p1) {
+        emit(TokenKind::Text, p1, p);
         p1 = p;
-        continue;
-      }
-      if (isCrlf(*p)) return true;
-      if (oneof(*p, "*_")) {
-        tokens.emplace_back(TokenKind::Emphasis, std::string{*p}, p1);
-        p1 = ++p;
-        continue;
-      }
-      if (*p == '!') {
-        tokens.emplace_back(TokenKind::Exclamation, "!", p1);
-        p1 = ++p;
-        continue;
-      }
-      if (*p == '`') {
-        tokens.emplace_back(TokenKind::BackQuote, "`", p1);
-        p1 = ++p;
-        continue;
-      }
-      if (oneof(*p, "[]()")) {
-        tokens.emplace_back(TokenKind::Bracket, std::string{*p}, p1);
-        p1 = ++p;
-        continue;
       }
+      if (p == limit || isCrlf(*p)) return true;
+      // the scan stops only at line breaks and these
+      const auto kind = isEmphasis(*p) ? TokenKind::Emphasis
+                        : *p == '!'    ? TokenKind::Exclamation
+                        : *p == '`'    ? TokenKind::BackQuote
+                                       : TokenKind::Bracket;
+      emit(kind, p1, ++p);
+      p1 = p;
     }
-    return true;
   }
 
   bool tokenizeNewLine(const char*& p) {
-    const char* loc = p;
-    if (isCR(*p)) ++p;
-    if (isLF(*p)) ++p;
-    if (loc == p) return false;
-    tokens.emplace_back(TokenKind::NewLine, "", loc);
+    const char* q = p;
+    if (isCR(*q)) ++q;
+    if (isLF(*q)) ++q;
+    if (q == p) return false;
+    emit(TokenKind::NewLine, p, q);
+    p = q;
     return true;
   }
 
   bool tokenizeUnorderedList(const char*& p) {
-    const char* loc = p;
     if (!oneof(*p, "*+-")) return false;
-    char c = *p;
-    ++p;
-    if (!isSpace(*p)) return false;
-    ++p;
-    tokens.emplace_back(TokenKind::Prefix, std::string{c} + " ", loc);
+    if (!isSpace(p[1])) return false;
+    emit(TokenKind::Prefix, p, p + 2);
+    p += 2;
     return true;
   }
 
   bool tokenizeOrderedList(const char*& p) {
-    const char* loc = p;
-    skipWhile(p, isDigit);
-    auto digits = std::string{loc, p};
-    if (*p != '.') return false;
-    ++p;
-    tokens.emplace_back(TokenKind::Prefix, digits + ".", loc);
+    const char* q = p;
+    while (isDigit(*q)) ++q;
+    if (*q != '.') {
+      context.plain = q;
+      return false;
+    }
+    ++q;
+    emit(TokenKind::Prefix, p, q);
+    p = q;
     return true;
   }
 
  private:
-  std::vector<Token> tokens;
+  void emit(TokenKind kind, const char* first, const char* last) {
+    emit(kind, first - stream.source, last - stream.source);
+  }
+
+  void emit(TokenKind kind, size_t first, size_t last) {
+    stream.tokens.push_back(Token{kind, static_cast<uint32_t>(first),
+                                  static_cast<uint32_t>(last - first)});
+  }
+
+  std::string text;  // the document so far
+  TokenStream stream;
+  std::vector<Token> spareTokens;  // set aside during an edit
+  std::vector<Line> spareLines;
   TokenizerContext context;
+  size_t tokenized;   // how much of text has been tokenized
+  const char* limit;  // end of the range being appended
+  const std::atomic<bool>* cancel;
+  TextScanner scan;
+
+  bool cancelled() const {
+    return cancel && cancel->load(std::memory_order_relaxed);
+  }
 };
 
 }  // namespace m2h
@@ -0,0 +1,104 @@
+// writes a header that compiles the editor's files into main.bin.
+// usage: embed_assets <output> <root> <file>...
+// each file is served at its path below root, with its Content-Type, ETag
+// and compressed copies worked out here instead of at every startup.
+#include <AssetCache.hpp>
+#include <Compression.hpp>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+const int BYTES_PER_LINE = 18;
+
+// the contents as a string literal, octal escapes only so no digit that
+// follows can be read as part of an escape
+std::string literal(const std::string &data) {
+  static const char digits[] = "01234567";
+  auto ret = std::string{"\""};
+  for (size_t i = 0; i < data.size(); ++i) {
+    if (i != 0 && i % BYTES_PER_LINE == 0) ret += "\"\n    \"";
+    const auto c = static_cast<unsigned char>(data[i]);
+    ret += '\\';
+    ret += digits[c >> 6];
+    ret += digits[(c >> 3) & 7];
+    ret += digits[c & 7];
+  }
+  return ret + "\"";
+}
+
+// FNV-1a, so the tag changes with the contents and nothing else
+std::string etag(const std::string &data) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+  std::stringstream ss;
+  ss << "\"\\\"" << std::hex << hash << "\\\"\"";
+  return ss.str();
+}
+
+std::string compressed(const std::string &data, ContentCoding coding) {
+  auto ret = compress(data, coding, ASSET_COMPRESSION_LEVEL);
+  return ret.size() < data.size() ? ret : std::string{};
+}
+
+int main(int argc, char const *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <output> <root> <file>..."
+              << std::endl;
+    return 1;
+  }
+  auto root = std::string{argv[2]};
+  if (!endsWith(root, "/")) root += "/";
+
+  std::stringstream arrays, table;
+  for (int i = 3; i < argc; ++i) {
+    const auto file = std::string{argv[i]};
+    if (!beginsWith(file, root)) {
+      std::cerr << "[error] " << file << " is not in " << root << std::endl;
+      return 1;
+    }
+    std::ifstream ifs(file, std::ios::binary);
+    if (!ifs.is_open()) {
+      std::cerr << "[error] failed to read " << file << std::endl;
+      return 1;
+    }
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    const auto data = ss.str();
+    const auto gzip = compressed(data, ContentCoding::Gzip);
+    const auto deflate = compressed(data, ContentCoding::Deflate);
+
+    const auto name = std::to_string(i - 3);
+    arrays << "constexpr char data" << name << "[] = " << literal(data)
+           << ";\n";
+    arrays << "constexpr char gzip" << name << "[] = " << literal(gzip)
+           << ";\n";
+    arrays << "constexpr char deflate" << name << "[] = " << literal(deflate)
+           << ";\n";
+    table << "    {\"/" << file.substr(root.size()) << "\", \""
+          << mimetype(file) << "\", " << etag(data) << ",\n"
+          << "     {editor_assets::data" << name << ", " << data.size()
+          << "},\n"
+          << "     {editor_assets::gzip" << name << ", " << gzip.size()
+          << "},\n"
+          << "     {editor_assets::deflate" << name << ", " << deflate.size()
+          << "}},\n";
+  }
+
+  std::ofstream ofs(argv[1], std::ios::binary);
+  ofs << "// generated by embed_assets, do not edit\n"
+      << "#pragma once\n\n"
+      << "#include <EmbeddedAsset.hpp>\n\n"
+      << "namespace editor_assets {\n"
+      << arrays.str() << "}  // namespace editor_assets\n\n"
+      << "constexpr EmbeddedAsset EDITOR_ASSETS[] = {\n"
+      << table.str() << "};\n";
+  if (!ofs) {
+    std::cerr << "[error] failed to write " << argv[1] << std::endl;
+    return 1;
+  }
+}
@@ -1,42 +1,46 @@
+#include <AssetCache.hpp>
 #include <HttpRequest.hpp>
 #include <HttpResponse.hpp>
 #include <HttpServer.hpp>
+#include <WebSocket.hpp>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
 #include <csignal>
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <string>
 
+#include "document/PieceTable.hpp"
+#include "parser/ParallelParser.hpp"
+#include "pipeline/Pipeline.hpp"
 #include "parser/Parser.hpp"
 #include "tokenizer/Tokenizer.hpp"
 
-std::string loadfile(std::ifstream& ifs) {
-  static char buffer[1024];
-  auto ret = std::string{};
-  while (!ifs.eof()) {
-    ifs.read(buffer, 1024);
-    ret.append(buffer, ifs.gcount());
-  }
-  return ret;
-}
-
-std::string mimetype(const std::string& target) {
-  auto mimetype = std::string{"text/html"};
-  if (endsWith(target, ".ico")) {
-    mimetype = "image/x-icon";
-  } else if (endsWith(target, ".js")) {
-    mimetype = "application/javascript";
-  } else if (endsWith(target, ".css")) {
-    mimetype = "text/css";
-  }
-  return mimetype;
-}
+#ifdef EMBED_EDITOR_ASSETS
+#include <EditorAssets.hpp>
+#else
+AssetCache assets;
+#endif
 
 HttpResponse get(const HttpRequest& request) {
-  const auto path = request.header.path;
+  const auto path = std::string{request.header.path};
   if (path.empty())
     return HttpResponse{"HTTP/1.1 404 Not Found", "text/html", "404 Not Found"};
 
+#ifdef EMBED_EDITOR_ASSETS
+  auto embedded =
+      findEmbedded(EDITOR_ASSETS, path == "/" ? "/index.html" : path);
+  if (!embedded)
+    return HttpResponse{"HTTP/1.1 404 Not Found", "text/html", "404 Not Found"};
+
+  return embeddedResponse(request.header, *embedded);
+#else
+
   if (contains(path, ".."))
     return HttpResponse{"HTTP/1.1 404 Not Found", "text/html", "404 Not Found"};
 
@@ -47,53 +51,354 @@ HttpResponse get(const HttpRequest& request) {
     target = "./editor" + path;
   }
 
-  std::ifstream ifs(target, std::ios::binary);
-  if (!ifs.is_open())
+  auto asset = assets.find(target);
+  if (!asset)
     return HttpResponse{"HTTP/1.1 404 Not Found", "text/html", "404 Not Found"};
 
-  return HttpResponse{"HTTP/1.1 200 OK", mimetype(target), loadfile(ifs)};
+  return assetResponse(request.header, *asset, mimetype(target));
+#endif
+}
+
+std::unique_ptr<HttpServer> server;
+
+// one tokenizer and parser per worker thread, reused across requests
+thread_local m2h::Tokenizer tokenizer;
+thread_local m2h::Parser parser;
+#ifdef __linux__
+// the chunks of a large document are parsed by whichever workers are idle
+thread_local m2h::ParallelParser parallelParser{
+    server->workers(),
+    [](std::function<void()> task) { server->submit(std::move(task)); },
+    [] { return server->idleWorkers(); }};
+#else
+// there are no workers to share, so each chunk gets a thread of its own
+thread_local m2h::ParallelParser parallelParser;
+#endif
+thread_local m2h::Pipeline pipeline;
+
+// render large documents with --pipeline on: tokenizing, parsing and
+// printing run at once, instead of each on all of the document in turn
+bool pipelined = false;
+
+bool pipelines(size_t size) {
+  return pipelined && size >= m2h::PIPELINE_MIN_SIZE;
 }
 
+// tokenizes an /update body while it is being received. the tokenizer's
+// buffer is reserved up front, so it is the only copy of the body. a body
+// large enough to be parsed on several cores or pipelined is kept whole
+// instead.
+struct MarkdownBody : BodyReader {
+  explicit MarkdownBody(size_t length)
+      : whole{pipelines(length) || parallelParser.splits(length)} {
+    if (whole) {
+      document.reserve(length);
+    } else {
+      tokenizer.reserve(length);
+    }
+  }
+
+  void read(std::string_view data) override {
+    if (whole) {
+      document.append(data);
+    } else {
+      tokenizer.feed(data);
+    }
+  }
+
+  const m2h::TokenStream& finish() { return tokenizer.finish(); }
+
+  bool whole;
+  std::string document;
+  m2h::Tokenizer tokenizer;
+};
+
 HttpResponse post(const HttpRequest& request) {
   const auto path = request.header.path;
   if (path != "/update")
     return HttpResponse{"HTTP/1.1 404 Not Found", "text/html", "404 Not Found"};
 
-  if (request.body.empty())
+  auto markdown = std::static_pointer_cast<MarkdownBody>(request.reader);
+  if (!markdown && request.body.empty())
     return HttpResponse{"HTTP/1.1 200 OK", "text/html", ""};
 
-  auto body = request.body + "\n";
-  m2h::Tokenizer tokenizer;
-  const auto& tokens = tokenizer.tokenize(body.c_str());
-  m2h::Parser parser;
-  const auto& nodes = parser.parse(tokens);
-  std::stringstream ss;
-  for (auto&& node : nodes) {
-    node->print(ss, "");
+  if (pipelines(markdown ? markdown->document.size() : request.body.size())) {
+    auto resp = HttpResponse{"HTTP/1.1 200 OK", "text/html", ""};
+    // the body stays alive with the stream
+    resp.stream = [markdown, body = markdown ? std::string{}
+                                             : std::string{request.body}](
+                      std::ostream& ost) {
+      pipeline.render(markdown ? markdown->document : body, ost);
+    };
+    return resp;
   }
-  return HttpResponse{"HTTP/1.1 200 OK", "text/html", ss.str()};
+
+  auto parse = [&]() -> const std::vector<m2h::Node*>& {
+    if (markdown && !markdown->whole) return parser.parse(markdown->finish());
+    const auto text = markdown ? std::string_view{markdown->document}
+                               : std::string_view{request.body};
+    if (parallelParser.splits(text.size())) return parallelParser.parse(text);
+    return parser.parse(tokenizer.tokenize(text));
+  };
+  const auto& nodes = parse();
+  auto resp = HttpResponse{"HTTP/1.1 200 OK", "text/html", ""};
+  // runs on this worker before the next parse, while nodes are still alive
+  resp.stream = [&nodes](std::ostream& ost) {
+    for (auto&& node : nodes) {
+      node->print(ost, "");
+    }
+  };
+  return resp;
 }
 
-int port = 8000;
-HttpServer server(port);
+const size_t MAX_PENDING_EDITS = 256;
+
+// live preview over a WebSocket, with the document kept on the server.
+// a message is "<revision>\n<text>" to replace the whole document or
+// "<revision> <offset> <erase>\n<text>" to replace erase bytes at offset,
+// offsets counted in bytes of UTF-8, and is answered with
+// "<revision>\n<html>". edits are applied on the event loop as they arrive
+// and a worker renders the newest revision, re-tokenizing only the lines
+// edited since the last rendering. the rendering is cancelled as
+// soon as another edit is applied, so edits arriving faster than the
+// document renders cost one rendering at a time.
+// the socket is closed on an edit that doesn't fit the document, and the
+// editor starts over with the whole document.
+struct PreviewSession : WebSocketSession,
+                        std::enable_shared_from_this<PreviewSession> {
+  explicit PreviewSession(std::shared_ptr<WebSocket> socket)
+      : socket{std::move(socket)},
+        synced{false},
+        resync{true},
+        applied{0},
+        rendering{false},
+        stale{false} {}
+
+  void onMessage(std::string&& message) override {
+    auto edit = Edit{};
+    uint64_t revision;
+    if (!parseEdit(message, revision, edit)) {
+      socket->close();
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (edit.whole) {
+      document.assign(std::move(edit.text));
+      synced = true;
+      resync = true;
+      pending.clear();
+    } else if (!synced || revision != applied + 1 ||
+               !document.replace(edit.offset, edit.erase, edit.text)) {
+      socket->close();
+      return;
+    } else if (!resync) {
+      pending.push_back(std::move(edit));
+      // a paste of many edits is cheaper to take as a whole
+      if (pending.size() > MAX_PENDING_EDITS) {
+        resync = true;
+        pending.clear();
+      }
+    }
+    applied = revision;
+    if (rendering) {
+      stale = true;
+      return;
+    }
+    rendering = true;
+    // the rendering may run right here where there are no workers
+    lock.unlock();
+    server->submit([self = shared_from_this()] { self->render(); });
+  }
+
+  // renders the newest revision until a rendering finishes before another
+  // edit is applied, then sends it
+  void render() {
+    auto text = std::string{};
+    auto edits = std::vector<Edit>{};
+    auto html = std::ostringstream{};
+    while (true) {
+      uint64_t revision;
+      bool whole;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        revision = applied;
+        whole = resync;
+        if (whole) {
+          text.clear();
+          document.copyTo(text);
+        }
+        resync = false;
+        edits.clear();
+        edits.swap(pending);
+        stale = false;
+      }
+
+      // an edit re-tokenizes the whole document if this was cancelled
+      if (whole) tokenizer.tokenize(text, &stale);
+      for (auto&& edit : edits) {
+        tokenizer.edit(edit.offset, edit.erase, edit.text);
+      }
+      const auto& tokens = tokenizer.tokens();
+      const auto& nodes = parser.parse(tokens, &stale);
+      html.str("");
+      html << revision << "\n";
+      for (auto&& node : nodes) {
+        if (stale) break;
+        node->print(html, "");
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!stale) {
+        rendering = false;
+        break;
+      }
+    }
+    socket->send(html.str());
+  }
+
+  struct Edit {
+    bool whole;
+    size_t offset;
+    size_t erase;
+    std::string text;
+  };
+
+  static bool parseEdit(std::string& message, uint64_t& revision, Edit& edit) {
+    const auto eol = message.find('\n');
+    if (eol == std::string::npos) return false;
+    char* next;
+    revision = std::strtoull(message.c_str(), &next, 10);
+    edit.whole = *next != ' ';
+    if (!edit.whole) {
+      edit.offset = std::strtoull(next + 1, &next, 10);
+      if (*next != ' ') return false;
+      edit.erase = std::strtoull(next + 1, &next, 10);
+    }
+    if (next != message.c_str() + eol) return false;
+    message.erase(0, eol + 1);
+    edit.text = std::move(message);
+    return true;
+  }
+
+  std::shared_ptr<WebSocket> socket;
+  std::mutex mutex;
+  m2h::PieceTable document;
+  bool synced;  // a whole document has been received
+  bool resync;  // the next rendering takes the whole document
+  std::vector<Edit> pending;  // applied since the last rendering began
+  m2h::Tokenizer tokenizer;   // the tokens of the last rendering
+  uint64_t applied;
+  bool rendering;
+  std::atomic<bool> stale;  // the rendering in progress is out of date
+};
 
 void sigintHandler(int sig) {
   std::cout << "\nReceived SIGINT signal. Cleaning up and exiting."
             << std::endl;
-  server.shutdown();
+  server->shutdown();
   std::exit(0);
 }
 
+const char USAGE[] =
+    "usage: main.bin [--address HOST] [--port 1-65535] [--backlog N]\n"
+    "                [--acceptors N] [--workers N] [--max-queued N]\n"
+    "                [--latency-budget MS] [--compression-level 0-9]\n"
+    "                [--compress-min-size BYTES] [--io-uring on|off]\n"
+    "                [--pipeline on|off]\n";
+
+// parses a whole decimal number within [min, max]
+bool parseNumber(const std::string& text, unsigned long long min,
+                 unsigned long long max, unsigned long long& value) {
+  if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0])))
+    return false;
+  char* end;
+  errno = 0;
+  value = std::strtoull(text.c_str(), &end, 10);
+  return errno == 0 && *end == '\0' && value >= min && value <= max;
+}
+
+bool parseSwitch(const std::string& text, bool& value) {
+  value = text == "on";
+  return value || text == "off";
+}
+
 int main(int argc, char const* argv[]) {
-  std::cout << "Server is running at http://127.0.0.1:" << port << std::endl;
+  auto options = HttpServerOptions{};
+  for (int i = 1; i < argc; i += 2) {
+    const auto option = std::string{argv[i]};
+    if (i + 1 == argc) {
+      std::cerr << "missing value for " << option << "\n" << USAGE;
+      return 1;
+    }
+    const auto value = std::string{argv[i + 1]};
+    const unsigned long long any = std::numeric_limits<size_t>::max();
+    const unsigned long long anyInt = std::numeric_limits<int>::max();
+    unsigned long long n = 0;
+    bool ok = true;
+    if (option == "--address") {
+      options.address = value;
+    } else if (option == "--port") {
+      ok = parseNumber(value, 1, 65535, n);
+      options.port = static_cast<unsigned short>(n);
+    } else if (option == "--backlog") {
+      ok = parseNumber(value, 1, anyInt, n);
+      options.backlog = static_cast<int>(n);
+    } else if (option == "--acceptors") {
+      ok = parseNumber(value, 1, any, n);
+      options.acceptors = n;
+    } else if (option == "--workers") {
+      ok = parseNumber(value, 1, any, n);
+      options.workers = n;
+    } else if (option == "--max-queued") {
+      ok = parseNumber(value, 1, any, n);
+      options.maxQueued = n;
+    } else if (option == "--latency-budget") {
+      ok = parseNumber(value, 1, anyInt, n);
+      options.latencyBudget = std::chrono::milliseconds(n);
+    } else if (option == "--compression-level") {
+      ok = parseNumber(value, 0, 9, n);
+      options.compressionLevel = static_cast<int>(n);
+    } else if (option == "--compress-min-size") {
+      ok = parseNumber(value, 0, any, n);
+      options.compressMinSize = n;
+    } else if (option == "--io-uring") {
+      ok = parseSwitch(value, options.ioUring);
+    } else if (option == "--pipeline") {
+      ok = parseSwitch(value, pipelined);
+    } else {
+      std::cerr << "unknown option " << option << "\n" << USAGE;
+      return 1;
+    }
+    if (!ok) {
+      std::cerr << "invalid value for " << option << ": " << value << "\n"
+                << USAGE;
+      return 1;
+    }
+  }
+
+#ifndef EMBED_EDITOR_ASSETS
+  // compress the editor once, before the first client asks for it
+  assets.preload("./editor");
+#endif
+
+  server.reset(new HttpServer(options));
+  server->streamBody("/update", [](size_t length) {
+    return std::make_shared<MarkdownBody>(length);
+  });
+  server->webSocket("/live", [](std::shared_ptr<WebSocket> socket) {
+    return std::make_shared<PreviewSession>(std::move(socket));
+  });
+  std::cout << "Server is running at http://" << options.address << ":"
+            << options.port << std::endl;
 
   if (std::signal(SIGINT, sigintHandler) == SIG_ERR) {
     perror("Error registering SIGINT handler");
     return 1;
   }
 
-  server.run([](const HttpRequest& request) {
-    const auto method = toUpper(request.header.method);
+  server->run([](const HttpRequest& request) {
+    const auto method = toUpper(std::string{request.header.method});
     if (method == "GET") {
       return get(request);
     } else if (method == "POST") {
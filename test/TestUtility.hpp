@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parser/Node.hpp"
+
+// a document of the corpus and the html the parser rendered it to before
+// it was rewritten
+struct CorpusDocument {
+  std::string name;
+  std::string markdown;
+  std::string html;
+};
+
+int failures = 0;
+
+// reports what went wrong unless ok. main returns failed().
+void expect(bool ok, const std::string& what) {
+  if (ok) return;
+  ++failures;
+  std::cerr << "FAIL " << what << std::endl;
+}
+
+int failed() {
+  if (failures == 0) return 0;
+  std::cerr << failures << " failed" << std::endl;
+  return 1;
+}
+
+std::string readFile(const std::filesystem::path& path) {
+  std::ifstream ifs(path, std::ios::binary);
+  std::stringstream buffer;
+  buffer << ifs.rdbuf();
+  return buffer.str();
+}
+
+// the .md files of directory, each with the .html file of the same name,
+// in name order
+std::vector<CorpusDocument> loadCorpus(const std::string& directory) {
+  auto documents = std::vector<CorpusDocument>{};
+  for (auto&& entry : std::filesystem::directory_iterator(directory)) {
+    const auto& path = entry.path();
+    if (path.extension() != ".md") continue;
+    auto html = path;
+    html.replace_extension(".html");
+    expect(std::filesystem::exists(html), "no " + html.string());
+    documents.push_back(CorpusDocument{path.filename().string(),
+                                       readFile(path), readFile(html)});
+  }
+  std::sort(documents.begin(), documents.end(),
+            [](const CorpusDocument& a, const CorpusDocument& b) {
+              return a.name < b.name;
+            });
+  expect(!documents.empty(), "no documents in " + directory);
+  return documents;
+}
+
+std::string render(const std::vector<m2h::Node*>& nodes) {
+  auto html = std::ostringstream{};
+  for (auto&& node : nodes) node->print(html, "");
+  return html.str();
+}
@@ -0,0 +1,121 @@
+// large documents parsed in chunks on several threads, or pipelined, must
+// render as parsing them whole does. they are made of the corpus's
+// documents, with separators that make chunks start inside lists and
+// inside code left open.
+#include <future>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TestUtility.hpp"
+#include "ThreadPool.hpp"
+#include "parser/ParallelParser.hpp"
+#include "parser/Parser.hpp"
+#include "pipeline/Pipeline.hpp"
+#include "tokenizer/Tokenizer.hpp"
+
+const size_t DOCUMENT_SIZE = 6 * m2h::PARALLEL_CHUNK_SIZE;
+const int DOCUMENTS = 8;
+
+std::vector<std::string> makeDocuments(
+    const std::vector<CorpusDocument>& corpus) {
+  const char* separators[] = {"",       "\n",        "\n\n",
+                              "\r\n\r\n", "\n\n- x\n\n", "\n```\n",
+                              "\n`\n\n"};
+  auto random = std::mt19937{23};
+  auto documents = std::vector<std::string>{};
+  for (int i = 0; i < DOCUMENTS; ++i) {
+    // the first half leaves out the separators that open code, so that
+    // more of its chunks are parsed apart rather than over again as one
+    const size_t kinds = i < DOCUMENTS / 2 ? 5 : std::size(separators);
+    auto document = std::string{};
+    while (document.size() < DOCUMENT_SIZE) {
+      document += corpus[random() % corpus.size()].markdown;
+      document += separators[random() % kinds];
+    }
+    documents.push_back(std::move(document));
+  }
+  return documents;
+}
+
+std::vector<std::string> renderWhole(
+    const std::vector<std::string>& documents) {
+  m2h::Tokenizer tokenizer;
+  m2h::Parser parser;
+  auto html = std::vector<std::string>{};
+  for (auto&& document : documents) {
+    html.push_back(render(parser.parse(tokenizer.tokenize(document))));
+  }
+  return html;
+}
+
+// each chunk but the first on a thread of its own
+void testThreads(const std::vector<std::string>& documents,
+                 const std::vector<std::string>& html) {
+  m2h::ParallelParser parser{4};
+  for (size_t i = 0; i < documents.size(); ++i) {
+    expect(parser.splits(documents[i].size()), "too small to split");
+    expect(render(parser.parse(documents[i])) == html[i],
+           "threads, document " + std::to_string(i));
+  }
+}
+
+ThreadPool* pool = nullptr;
+// made on each worker when it first parses, as in the server
+thread_local m2h::ParallelParser poolParser{
+    pool->size(),
+    [](std::function<void()> task) { pool->submit(std::move(task)); },
+    [] { return pool->idle(); }};
+
+// the chunks go to whichever workers of the pool are idle, as in the
+// server, where the parse itself runs on a worker
+void testPool(const std::vector<std::string>& documents,
+              const std::vector<std::string>& html, size_t workers) {
+  ThreadPool threads{workers};
+  pool = &threads;
+  auto results = std::vector<std::future<bool>>{};
+  for (int round = 0; round < 2; ++round) {
+    for (size_t i = 0; i < documents.size(); ++i) {
+      auto done = std::make_shared<std::promise<bool>>();
+      results.push_back(done->get_future());
+      threads.submit([&, i, done] {
+        done->set_value(render(poolParser.parse(documents[i])) == html[i]);
+      });
+    }
+  }
+  for (size_t i = 0; i < results.size(); ++i) {
+    expect(results[i].get(), "pool of " + std::to_string(workers) +
+                                 ", document " +
+                                 std::to_string(i % documents.size()));
+  }
+}
+
+// one pipeline for all the documents, as each worker of the server has
+void testPipeline(const std::vector<std::string>& documents,
+                  const std::vector<std::string>& html) {
+  m2h::Pipeline pipeline;
+  for (size_t i = 0; i < documents.size(); ++i) {
+    auto out = std::ostringstream{};
+    pipeline.render(documents[i], out);
+    expect(out.str() == html[i], "pipeline, document " + std::to_string(i));
+  }
+}
+
+int main(int argc, char const* argv[]) {
+  if (argc != 2) {
+    std::cerr << "usage: parallel_test CORPUS_DIRECTORY" << std::endl;
+    return 2;
+  }
+  const auto corpus = loadCorpus(argv[1]);
+  if (corpus.empty()) return failed();
+
+  const auto documents = makeDocuments(corpus);
+  const auto html = renderWhole(documents);
+  testThreads(documents, html);
+  testPool(documents, html, 1);
+  testPool(documents, html, 3);
+  testPipeline(documents, html);
+  return failed();
+}
@@ -0,0 +1,27 @@
+// renders every document of the corpus and compares it with the html the
+// parser gave before it was rewritten. a change meant to alter the output
+// updates the .html files along with it.
+#include <iostream>
+
+#include "TestUtility.hpp"
+#include "parser/Parser.hpp"
+#include "tokenizer/Tokenizer.hpp"
+
+int main(int argc, char const* argv[]) {
+  if (argc != 2) {
+    std::cerr << "usage: parser_test CORPUS_DIRECTORY" << std::endl;
+    return 2;
+  }
+  const auto documents = loadCorpus(argv[1]);
+
+  // reused across documents, as the server's workers reuse theirs
+  m2h::Tokenizer tokenizer;
+  m2h::Parser parser;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (auto&& document : documents) {
+      const auto& nodes = parser.parse(tokenizer.tokenize(document.markdown));
+      expect(render(nodes) == document.html, document.name);
+    }
+  }
+  return failed();
+}
@@ -0,0 +1,91 @@
+// the tokens of a document fed in small chunks, and of a document edited
+// in place, must be those of tokenizing it whole
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "TestUtility.hpp"
+#include "tokenizer/Tokenizer.hpp"
+
+const int EDITS_PER_DOCUMENT = 40;
+
+bool sameTokens(const m2h::TokenStream& a, const m2h::TokenStream& b) {
+  if (a.tokens.size() != b.tokens.size()) return false;
+  if (a.lines.size() != b.lines.size()) return false;
+  for (size_t i = 0; i < a.tokens.size(); ++i) {
+    if (a.tokens[i].kind != b.tokens[i].kind ||
+        a.tokens[i].offset != b.tokens[i].offset ||
+        a.tokens[i].length != b.tokens[i].length)
+      return false;
+  }
+  for (size_t i = 0; i < a.lines.size(); ++i) {
+    if (a.lines[i].offset != b.lines[i].offset ||
+        a.lines[i].token != b.lines[i].token)
+      return false;
+  }
+  return true;
+}
+
+std::string withCrlf(const std::string& text) {
+  auto result = std::string{};
+  for (char c : text) {
+    if (c == '\n') result += '\r';
+    result += c;
+  }
+  return result;
+}
+
+// chunks of up to 6 bytes split list prefixes, CRLF pairs and fences
+void testFeed(const CorpusDocument& document, std::mt19937& random) {
+  for (auto&& text : {document.markdown, withCrlf(document.markdown)}) {
+    m2h::Tokenizer whole, fed;
+    const auto& expected = whole.tokenize(text);
+    fed.reset();
+    for (size_t i = 0; i < text.size();) {
+      const size_t n = random() % 7;
+      fed.feed(std::string_view{text}.substr(i, n));
+      i += n;
+    }
+    expect(sameTokens(fed.finish(), expected), "feed " + document.name);
+  }
+}
+
+void testEdit(const CorpusDocument& document, std::mt19937& random,
+              bool cancelled) {
+  const char* inserts[] = {"",     "x",   "\n",  "\r",   "\r\n",
+                           "```\n", "`",  "---", "- ",   "1. ",
+                           "# ",   "\t",  "> ",  "a\nb", "```"};
+  auto text = document.markdown;
+  m2h::Tokenizer edited, whole;
+  // a tokenizing cancelled part way leaves the next edit all of it to do
+  const std::atomic<bool> cancel{cancelled};
+  edited.tokenize(text, &cancel);
+  for (int i = 0; i < EDITS_PER_DOCUMENT; ++i) {
+    const size_t offset = random() % (text.size() + 1);
+    const size_t erase = std::min<size_t>(random() % 4, text.size() - offset);
+    const std::string insert = inserts[random() % std::size(inserts)];
+    edited.edit(offset, erase, insert);
+    text.replace(offset, erase, insert);
+    if (!sameTokens(edited.tokens(), whole.tokenize(text))) {
+      expect(false, "edit " + document.name + " at " + std::to_string(offset));
+      return;
+    }
+  }
+}
+
+int main(int argc, char const* argv[]) {
+  if (argc != 2) {
+    std::cerr << "usage: tokenizer_test CORPUS_DIRECTORY" << std::endl;
+    return 2;
+  }
+  const auto documents = loadCorpus(argv[1]);
+
+  auto random = std::mt19937{21};
+  for (auto&& document : documents) {
+    testFeed(document, random);
+    testEdit(document, random, false);
+    testEdit(document, random, true);
+  }
+  return failed();
+}